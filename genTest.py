@@ -1,9 +1,14 @@
 
 import random
+import sys
 
-INSERT_NUM = 100
+# Usage: genTest.py [INSERT_NUM [DELETE_NUM [SEED]]], the seed replays the same test
+INSERT_NUM = int (sys.argv[1]) if len (sys.argv) > 1 else 100
 # <= INSERT_NUM
-DELETE_NUM = 20
+DELETE_NUM = int (sys.argv[2]) if len (sys.argv) > 2 else 20
+
+if len (sys.argv) > 3 :
+    random.seed (int (sys.argv[3]))
 
 elems = list (range (1, INSERT_NUM))
 random.shuffle (elems)
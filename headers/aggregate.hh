@@ -0,0 +1,113 @@
+
+#include <concepts>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
+#ifndef AGGREGATE_HH_INCL
+#define AGGREGATE_HH_INCL
+
+namespace tree
+{
+
+// Aggregate policy is a monoid over tree elements: every node keeps
+// combine (left sub tree, lift (data), right sub tree). Combine has to be
+// associative with identity () as neutral element, commutativity is not needed.
+template <class Policy, class Data>
+concept AggregatePolicy = requires(const Data &data, const typename Policy::value_type &value) {
+  { Policy::identity() } -> std::convertible_to<typename Policy::value_type>;
+  { Policy::lift(data) } -> std::convertible_to<typename Policy::value_type>;
+  { Policy::combine(value, value) } -> std::convertible_to<typename Policy::value_type>;
+};
+
+// Default policy, keeps nothing.
+struct NoAggregate
+{
+  struct value_type
+  {};
+
+  static value_type identity() noexcept
+  {
+    return {};
+  }
+
+  template <class Data>
+  static value_type lift(const Data &) noexcept
+  {
+    return {};
+  }
+
+  static value_type combine(value_type, value_type) noexcept
+  {
+    return {};
+  }
+};
+
+// Sum of projected elements, e.g. weights for weighted select.
+template <class Data, class Proj = std::identity>
+struct SumAggregate
+{
+  using value_type = std::remove_cvref_t<std::invoke_result_t<Proj, const Data &>>;
+
+  static value_type identity()
+  {
+    return value_type{};
+  }
+
+  static value_type lift(const Data &data)
+  {
+    return std::invoke(Proj{}, data);
+  }
+
+  static value_type combine(const value_type &lhs, const value_type &rhs)
+  {
+    return lhs + rhs;
+  }
+};
+
+// Minimum and maximum of projected arithmetic values.
+template <class Data, class Proj = std::identity>
+struct MinAggregate
+{
+  using value_type = std::remove_cvref_t<std::invoke_result_t<Proj, const Data &>>;
+
+  static value_type identity()
+  {
+    return std::numeric_limits<value_type>::max();
+  }
+
+  static value_type lift(const Data &data)
+  {
+    return std::invoke(Proj{}, data);
+  }
+
+  static value_type combine(const value_type &lhs, const value_type &rhs)
+  {
+    return rhs < lhs ? rhs : lhs;
+  }
+};
+
+template <class Data, class Proj = std::identity>
+struct MaxAggregate
+{
+  using value_type = std::remove_cvref_t<std::invoke_result_t<Proj, const Data &>>;
+
+  static value_type identity()
+  {
+    return std::numeric_limits<value_type>::lowest();
+  }
+
+  static value_type lift(const Data &data)
+  {
+    return std::invoke(Proj{}, data);
+  }
+
+  static value_type combine(const value_type &lhs, const value_type &rhs)
+  {
+    return lhs < rhs ? rhs : lhs;
+  }
+};
+
+} // namespace tree
+
+#endif // #ifndef AGGREGATE_HH_INCL
@@ -0,0 +1,268 @@
+
+#include "block-tree.hh"
+
+#ifndef BLOCK_TREE_IMPL_HH_INCL
+#define BLOCK_TREE_IMPL_HH_INCL
+
+namespace tree
+{
+
+#if defined(__SSE2__)
+template <class Data, class Allocator>
+__m128i BlockStatTree<Data, Allocator>::greater64(__m128i lhs, __m128i rhs) noexcept
+{
+#if defined(__SSE4_2__)
+  return _mm_cmpgt_epi64(lhs, rhs);
+#else
+  // High halves are compared as signed, low ones as unsigned, if high halves are equal.
+  const __m128i lowBias = _mm_set_epi32(0, std::numeric_limits<int32_t>::min(), 0, std::numeric_limits<int32_t>::min());
+  __m128i greater = _mm_cmpgt_epi32(_mm_xor_si128(lhs, lowBias), _mm_xor_si128(rhs, lowBias));
+  __m128i equal = _mm_cmpeq_epi32(lhs, rhs);
+  __m128i lowGreater = _mm_shuffle_epi32(greater, _MM_SHUFFLE(2, 2, 0, 0));
+  __m128i result = _mm_or_si128(greater, _mm_and_si128(equal, lowGreater));
+  return _mm_shuffle_epi32(result, _MM_SHUFFLE(3, 3, 1, 1));
+#endif
+}
+#endif
+
+template <class Data, class Allocator>
+size_t BlockStatTree<Data, Allocator>::countLess(const Block &block, Data key) noexcept
+{
+  [[maybe_unused]] constexpr bool IS_INT32 = std::is_integral_v<Data> && sizeof(Data) == 4;
+  [[maybe_unused]] constexpr bool IS_INT64 = std::is_integral_v<Data> && sizeof(Data) == 8;
+  // Unsigned keys are compared as signed ones with the highest bit flipped.
+  [[maybe_unused]] constexpr int32_t BIAS32 = std::is_unsigned_v<Data> ? std::numeric_limits<int32_t>::min() : 0;
+  [[maybe_unused]] constexpr int64_t BIAS64 = std::is_unsigned_v<Data> ? std::numeric_limits<int64_t>::min() : 0;
+
+  const Data *keys = block.keys_;
+  size_t count = 0;
+
+#if defined(__AVX2__)
+  if constexpr (IS_INT32)
+  {
+    __m256i bias = _mm256_set1_epi32(BIAS32);
+    __m256i keyVec = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(key)), bias);
+    for (size_t i = 0; i < BLOCK_SIZE; i += 8)
+    {
+      __m256i keysVec = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)), bias);
+      auto mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(keyVec, keysVec)));
+      count += static_cast<size_t>(std::popcount(static_cast<unsigned>(mask)));
+    }
+    return count;
+  }
+  if constexpr (IS_INT64)
+  {
+    __m256i bias = _mm256_set1_epi64x(BIAS64);
+    __m256i keyVec = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(key)), bias);
+    for (size_t i = 0; i < BLOCK_SIZE; i += 4)
+    {
+      __m256i keysVec = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)), bias);
+      auto mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(keyVec, keysVec)));
+      count += static_cast<size_t>(std::popcount(static_cast<unsigned>(mask)));
+    }
+    return count;
+  }
+#endif
+
+#if defined(__SSE2__)
+  if constexpr (IS_INT32)
+  {
+    __m128i bias = _mm_set1_epi32(BIAS32);
+    __m128i keyVec = _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(key)), bias);
+    for (size_t i = 0; i < BLOCK_SIZE; i += 4)
+    {
+      __m128i keysVec = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i)), bias);
+      auto mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(keyVec, keysVec)));
+      count += static_cast<size_t>(std::popcount(static_cast<unsigned>(mask)));
+    }
+    return count;
+  }
+  if constexpr (IS_INT64)
+  {
+    __m128i bias = _mm_set1_epi64x(BIAS64);
+    __m128i keyVec = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(key)), bias);
+    for (size_t i = 0; i < BLOCK_SIZE; i += 2)
+    {
+      __m128i keysVec = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i)), bias);
+      auto mask = _mm_movemask_pd(_mm_castsi128_pd(greater64(keyVec, keysVec)));
+      count += static_cast<size_t>(std::popcount(static_cast<unsigned>(mask)));
+    }
+    return count;
+  }
+#endif
+
+  // No branches, so the compiler is free to vectorize it.
+  for (size_t i = 0; i < BLOCK_SIZE; ++i)
+    count += keys[i] < key ? 1 : 0;
+  return count;
+}
+
+template <class Data, class Allocator>
+std::pair<typename BlockStatTree<Data, Allocator>::Iterator, bool> BlockStatTree<Data, Allocator>::insert(Data key)
+{
+  if (tree_.empty())
+  {
+    Block block{key, 1, {}};
+    block.keys_[0] = key;
+    std::fill(block.keys_ + 1, block.keys_ + BLOCK_SIZE, PAD);
+    return {Iterator{tree_.insert(block).first, 0}, true};
+  }
+
+  // Keys greater than all others go to the last block.
+  BlockIterator block = findBlock(key);
+  if (block == tree_.end())
+    --block;
+
+  size_t idx = countLess(*block, key);
+  if (idx < block->size_ && block->keys_[idx] == key)
+    return {Iterator{block, idx}, false};
+
+  if (block->size_ == BLOCK_SIZE)
+  {
+    BlockIterator upper = splitBlock(block);
+    if (idx > block->size_)
+    {
+      idx -= block->size_;
+      block = upper;
+    }
+  }
+
+  // Maximum changes only if key is appended, it stays less than the next block keys.
+  tree_.modify(block, [key, idx](Block &modified) {
+    std::copy_backward(modified.keys_ + idx, modified.keys_ + modified.size_, modified.keys_ + modified.size_ + 1);
+    modified.keys_[idx] = key;
+    ++modified.size_;
+    modified.max_ = modified.keys_[modified.size_ - 1];
+  });
+  return {Iterator{block, idx}, true};
+}
+
+template <class Data, class Allocator>
+size_t BlockStatTree<Data, Allocator>::erase(Data key)
+{
+  BlockIterator block = findBlock(key);
+  if (block == tree_.end())
+    return 0;
+
+  // Block maximum is not less than key, so idx is inside the block.
+  size_t idx = countLess(*block, key);
+  if (block->keys_[idx] != key)
+    return 0;
+
+  if (block->size_ == 1)
+  {
+    tree_.erase(block);
+    return 1;
+  }
+
+  tree_.modify(block, [idx](Block &modified) {
+    std::copy(modified.keys_ + idx + 1, modified.keys_ + modified.size_, modified.keys_ + idx);
+    --modified.size_;
+    modified.keys_[modified.size_] = PAD;
+    modified.max_ = modified.keys_[modified.size_ - 1];
+  });
+
+  if (block->size_ < MERGE_SIZE)
+    mergeBlock(block);
+  return 1;
+}
+
+template <class Data, class Allocator>
+typename BlockStatTree<Data, Allocator>::BlockIterator BlockStatTree<Data, Allocator>::splitBlock(BlockIterator block)
+{
+  size_t half = block->size_ / 2;
+
+  Block upper{block->max_, static_cast<uint32_t>(block->size_ - half), {}};
+  std::copy(block->keys_ + half, block->keys_ + block->size_, upper.keys_);
+  std::fill(upper.keys_ + upper.size_, upper.keys_ + BLOCK_SIZE, PAD);
+
+  // Node for the upper block is allocated before the lower one is cut.
+  tree_.reserve(tree_.size() + 1);
+  tree_.modify(block, [half](Block &lower) {
+    std::fill(lower.keys_ + half, lower.keys_ + lower.size_, PAD);
+    lower.size_ = static_cast<uint32_t>(half);
+    lower.max_ = lower.keys_[half - 1];
+  });
+
+  return tree_.insert(upper).first;
+}
+
+template <class Data, class Allocator>
+void BlockStatTree<Data, Allocator>::mergeBlock(BlockIterator block)
+{
+  BlockIterator left = block;
+  BlockIterator right = std::next(block);
+  if (right == tree_.end() || left->size_ + right->size_ > BLOCK_SIZE / 2)
+  {
+    if (block == tree_.begin())
+      return;
+    left = std::prev(block);
+    right = block;
+    if (left->size_ + right->size_ > BLOCK_SIZE / 2)
+      return;
+  }
+
+  // Left keys are prepended to the right block, so maximums keep their order.
+  const Block &from = *left;
+  tree_.modify(right, [&from](Block &to) {
+    std::copy_backward(to.keys_, to.keys_ + to.size_, to.keys_ + to.size_ + from.size_);
+    std::copy(from.keys_, from.keys_ + from.size_, to.keys_);
+    to.size_ += from.size_;
+  });
+  tree_.erase(left);
+}
+
+template <class Data, class Allocator>
+typename BlockStatTree<Data, Allocator>::Iterator BlockStatTree<Data, Allocator>::find(Data key) const
+{
+  BlockIterator block = findBlock(key);
+  if (block == tree_.end())
+    return end();
+
+  size_t idx = countLess(*block, key);
+  if (block->keys_[idx] != key)
+    return end();
+  return Iterator{block, idx};
+}
+
+template <class Data, class Allocator>
+typename BlockStatTree<Data, Allocator>::Iterator BlockStatTree<Data, Allocator>::lower_bound(Data key) const
+{
+  BlockIterator block = findBlock(key);
+  if (block == tree_.end())
+    return end();
+  return Iterator{block, countLess(*block, key)};
+}
+
+template <class Data, class Allocator>
+size_t BlockStatTree<Data, Allocator>::rank(Data key) const
+{
+  BlockIterator block = findBlock(key);
+  if (block == tree_.end())
+    return size();
+  return tree_.aggregateBefore(key) + countLess(*block, key);
+}
+
+template <class Data, class Allocator>
+typename BlockStatTree<Data, Allocator>::Iterator BlockStatTree<Data, Allocator>::select(size_t k) const
+{
+  size_t before = 0;
+  BlockIterator block = tree_.findPrefix([k](size_t prefix) { return prefix > k; }, &before);
+  if (block == tree_.end())
+    return end();
+  return Iterator{block, k - before};
+}
+
+template <class Data, class Allocator>
+size_t BlockStatTree<Data, Allocator>::countInRange(Data lo, Data hi) const
+{
+  if (hi < lo)
+    return 0;
+
+  size_t notGreater = rank(hi) + (find(hi) == end() ? 0 : 1);
+  return notGreater - rank(lo);
+}
+
+} // namespace tree
+
+#endif // #ifndef BLOCK_TREE_IMPL_HH_INCL
@@ -0,0 +1,255 @@
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "tree.hh"
+
+#ifndef BLOCK_TREE_HH_INCL
+#define BLOCK_TREE_HH_INCL
+
+namespace tree
+{
+
+// Keys that BlockStatTree can hold: plain numbers in natural order.
+template <class Data, class Compare>
+concept BlockKey = std::is_arithmetic_v<Data> && !std::same_as<Data, bool> && std::same_as<Compare, std::less<Data>>;
+
+// Order statistic tree of numbers. Keys are stored by sorted blocks of BLOCK_SIZE,
+// blocks are elements of RB StatTree ordered by their last keys, so the pointer
+// chasing part of a descent is log2 (BLOCK_SIZE) levels shorter. Block is searched
+// by counting keys less than the searched one over the whole block, which is done
+// with SSE2 / AVX2 compares for signed and unsigned 32 and 64 bit integers (if the
+// target supports them) and is a branchless loop otherwise. Free block slots are filled with the greatest
+// value, so they are never counted.
+// Block sizes are sub tree aggregates of the StatTree, so rank and select take
+// O(log n) as well. Iterators are invalidated by insert and erase.
+template <class Data, class Allocator = std::allocator<Data>>
+class BlockStatTree
+{
+  friend struct TreeTester;
+
+  static_assert(BlockKey<Data, std::less<Data>>, "BlockStatTree holds arithmetic keys only");
+
+  static constexpr size_t BLOCK_BYTES = 256;
+  static constexpr size_t BLOCK_SIZE = BLOCK_BYTES / sizeof(Data);
+  // Block which gets smaller than this is merged with its neighbour if they fit half a block.
+  static constexpr size_t MERGE_SIZE = BLOCK_SIZE / 4;
+
+  static constexpr Data PAD =
+    std::numeric_limits<Data>::has_infinity ? std::numeric_limits<Data>::infinity() : std::numeric_limits<Data>::max();
+
+  struct Block
+  {
+    // Copy of the last key, the first thing a descent reads.
+    Data max_;
+    uint32_t size_;
+    Data keys_[BLOCK_SIZE];
+  };
+
+  // Compares blocks by their last keys, and with bare keys as well.
+  struct BlockLess
+  {
+    using is_transparent = void;
+
+    bool operator()(const Block &lhs, const Block &rhs) const noexcept
+    {
+      return lhs.max_ < rhs.max_;
+    }
+
+    bool operator()(const Block &lhs, Data rhs) const noexcept
+    {
+      return lhs.max_ < rhs;
+    }
+
+    bool operator()(Data lhs, const Block &rhs) const noexcept
+    {
+      return lhs < rhs.max_;
+    }
+  };
+
+  struct SizeOf
+  {
+    size_t operator()(const Block &block) const noexcept
+    {
+      return block.size_;
+    }
+  };
+
+  using BlockAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Block>;
+  using Tree = StatTree<Block, BlockLess, BlockAllocator, SumAggregate<Block, SizeOf>>;
+  using BlockIterator = typename Tree::Iterator;
+
+  Tree tree_;
+
+public:
+  // Bidirectional in-order iterator: block and position in it.
+  class Iterator
+  {
+    friend BlockStatTree;
+
+    BlockIterator block_{};
+    size_t idx_ = 0;
+
+    Iterator(BlockIterator block, size_t idx) : block_{block}, idx_{idx}
+    {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Data;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Data *;
+    using reference = const Data &;
+
+    Iterator() = default;
+
+    const Data &operator*() const noexcept
+    {
+      return block_->keys_[idx_];
+    }
+
+    const Data *operator->() const noexcept
+    {
+      return &block_->keys_[idx_];
+    }
+
+    Iterator &operator++() noexcept
+    {
+      if (++idx_ == block_->size_)
+      {
+        ++block_;
+        idx_ = 0;
+      }
+      return *this;
+    }
+
+    Iterator operator++(int) noexcept
+    {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    Iterator &operator--() noexcept
+    {
+      if (idx_ == 0)
+      {
+        --block_;
+        idx_ = block_->size_;
+      }
+      --idx_;
+      return *this;
+    }
+
+    Iterator operator--(int) noexcept
+    {
+      Iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    bool operator==(const Iterator &sd) const noexcept
+    {
+      return block_ == sd.block_ && idx_ == sd.idx_;
+    }
+  };
+
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+
+  BlockStatTree() = default;
+
+  explicit BlockStatTree(const Allocator &alloc) : tree_{BlockLess{}, BlockAllocator{alloc}}
+  {}
+
+  Iterator begin() const noexcept
+  {
+    return Iterator{tree_.begin(), 0};
+  }
+
+  Iterator end() const noexcept
+  {
+    return Iterator{tree_.end(), 0};
+  }
+
+  size_t size() const noexcept
+  {
+    return tree_.aggregate();
+  }
+
+  bool empty() const noexcept
+  {
+    return tree_.empty();
+  }
+
+  // Inserts key if it is absent. Returns iterator to the key and 'true' if the
+  // insertion took place.
+  std::pair<Iterator, bool> insert(Data key);
+
+  // Returns the number of erased elements.
+  size_t erase(Data key);
+
+  Iterator find(Data key) const;
+
+  // First element not less than key.
+  Iterator lower_bound(Data key) const;
+
+  // Number of elements less than key.
+  size_t rank(Data key) const;
+
+  // Element with k elements before it (k is zero based), end() if k >= size().
+  Iterator select(size_t k) const;
+
+  // Number of elements in [lo, hi].
+  size_t countInRange(Data lo, Data hi) const;
+
+  void clear() noexcept
+  {
+    tree_.clear();
+  }
+
+private:
+  // Number of keys less than key in the block.
+  static size_t countLess(const Block &block, Data key) noexcept;
+
+#if defined(__SSE2__)
+  // Mask of lanes where signed 64-bit lhs is greater than rhs, with SSE2 only if
+  // SSE4.2 is not enabled.
+  static __m128i greater64(__m128i lhs, __m128i rhs) noexcept;
+#endif
+
+  // Block which range contains key (the first one with max_ not less than key),
+  // end if key is greater than all keys.
+  BlockIterator findBlock(Data key) const
+  {
+    return tree_.lower_bound(key);
+  }
+
+  // Moves the upper half of the full block to a new block after it.
+  BlockIterator splitBlock(BlockIterator block);
+
+  // Merges the block with a small neighbour if any.
+  void mergeBlock(BlockIterator block);
+};
+
+// BlockStatTree for the keys it can hold, StatTree otherwise.
+template <class Data, class Compare = std::less<Data>>
+using FastStatTree = std::conditional_t<BlockKey<Data, Compare>, BlockStatTree<Data>, StatTree<Data, Compare>>;
+
+} // namespace tree
+
+#include "block-tree-impl.hh"
+
+#endif // #ifndef BLOCK_TREE_HH_INCL
@@ -0,0 +1,405 @@
+
+#include "compact-tree.hh"
+
+#ifndef COMPACT_TREE_IMPL_HH_INCL
+#define COMPACT_TREE_IMPL_HH_INCL
+
+namespace tree
+{
+
+template <class Data, class Compare, class Allocator>
+typename CompactStatTree<Data, Compare, Allocator>::Index CompactStatTree<Data, Compare, Allocator>::getNext(
+  Index idx) const noexcept
+{
+  if (at(idx).right_ != NIL)
+    return getLeftmost(at(idx).right_);
+
+  Index parent = at(idx).parent_;
+  while (parent != NIL && idx == at(parent).right_)
+  {
+    idx = parent;
+    parent = at(idx).parent_;
+  }
+  return parent;
+}
+
+template <class Data, class Compare, class Allocator>
+typename CompactStatTree<Data, Compare, Allocator>::Index CompactStatTree<Data, Compare, Allocator>::getPrev(
+  Index idx) const noexcept
+{
+  if (at(idx).left_ != NIL)
+    return getRightmost(at(idx).left_);
+
+  Index parent = at(idx).parent_;
+  while (parent != NIL && idx == at(parent).left_)
+  {
+    idx = parent;
+    parent = at(idx).parent_;
+  }
+  return parent;
+}
+
+template <class Data, class Compare, class Allocator>
+typename CompactStatTree<Data, Compare, Allocator>::Index CompactStatTree<Data, Compare, Allocator>::allocate(
+  const Data &data)
+{
+  Index idx = free_;
+  if (idx != NIL)
+  {
+    free_ = at(idx).left_;
+    at(idx).data_ = data;
+  }
+  else
+  {
+    if (nodes_.size() >= SIZE_MASK)
+      throw std::length_error{"CompactStatTree: too many nodes"};
+    idx = static_cast<Index>(nodes_.size());
+    nodes_.emplace_back(std::in_place, data);
+  }
+
+  Node &node = at(idx);
+  node.left_ = node.right_ = node.parent_ = NIL;
+  node.sizeColor_ = RED_BIT | 1;
+  return idx;
+}
+
+template <class Data, class Compare, class Allocator>
+template <class Key>
+typename CompactStatTree<Data, Compare, Allocator>::Index CompactStatTree<Data, Compare, Allocator>::lowerBoundNode(
+  const Key &key) const
+{
+  Index cur = root_;
+  Index bound = NIL;
+
+  while (cur != NIL)
+  {
+    const Node &node = at(cur);
+    if (comp_(node.data_, key))
+      cur = node.right_;
+    else
+    {
+      bound = cur;
+      cur = node.left_;
+    }
+  }
+
+  return bound;
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+typename CompactStatTree<Data, Compare, Allocator>::Iterator CompactStatTree<Data, Compare, Allocator>::find(
+  const Key &key) const
+{
+  Index bound = lowerBoundNode(key);
+  if (bound == NIL || comp_(key, at(bound).data_))
+    return end();
+
+  return Iterator{bound, this};
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+typename CompactStatTree<Data, Compare, Allocator>::Iterator CompactStatTree<Data, Compare, Allocator>::lower_bound(
+  const Key &key) const
+{
+  return Iterator{lowerBoundNode(key), this};
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+size_t CompactStatTree<Data, Compare, Allocator>::rank(const Key &key) const
+{
+  size_t count = 0;
+  Index cur = root_;
+
+  while (cur != NIL)
+  {
+    const Node &node = at(cur);
+    if (comp_(node.data_, key))
+    {
+      count += getSize(node.left_) + 1;
+      cur = node.right_;
+    }
+    else
+      cur = node.left_;
+  }
+
+  return count;
+}
+
+template <class Data, class Compare, class Allocator>
+typename CompactStatTree<Data, Compare, Allocator>::Iterator CompactStatTree<Data, Compare, Allocator>::select(
+  size_t k) const
+{
+  if (k >= size_)
+    return end();
+
+  Index cur = root_;
+  for (size_t leftSize = getSize(at(cur).left_); k != leftSize; leftSize = getSize(at(cur).left_))
+  {
+    if (k < leftSize)
+      cur = at(cur).left_;
+    else
+    {
+      k -= leftSize + 1;
+      cur = at(cur).right_;
+    }
+  }
+
+  return Iterator{cur, this};
+}
+
+template <class Data, class Compare, class Allocator>
+std::pair<typename CompactStatTree<Data, Compare, Allocator>::Iterator, bool> CompactStatTree<
+  Data, Compare, Allocator>::insert(const Data &data)
+{
+  Index parent = NIL;
+  bool toLeft = true;
+  // Last node not greater than data.
+  Index candidate = NIL;
+
+  for (Index cur = root_; cur != NIL;)
+  {
+    parent = cur;
+    toLeft = comp_(data, at(cur).data_);
+    if (toLeft)
+      cur = at(cur).left_;
+    else
+    {
+      candidate = cur;
+      cur = at(cur).right_;
+    }
+  }
+
+  if (candidate != NIL && !comp_(at(candidate).data_, data))
+    return {Iterator{candidate, this}, false};
+
+  // Nodes storage can be reallocated here, so no references are kept.
+  Index idx = allocate(data);
+  at(idx).parent_ = parent;
+  if (parent == NIL)
+    root_ = idx;
+  else if (toLeft)
+    at(parent).left_ = idx;
+  else
+    at(parent).right_ = idx;
+
+  for (Index cur = parent; cur != NIL; cur = at(cur).parent_)
+    ++at(cur).sizeColor_;
+  ++size_;
+
+  insertFixup(idx);
+  return {Iterator{idx, this}, true};
+}
+
+template <class Data, class Compare, class Allocator>
+void CompactStatTree<Data, Compare, Allocator>::erase(Iterator delIt)
+{
+  if (delIt == end())
+    return;
+
+  Index del = delIt.idx_;
+
+  // Node that will be physically removed from its place: del itself or its next.
+  Index removed = del;
+  if (at(del).left_ != NIL && at(del).right_ != NIL)
+    removed = getLeftmost(at(del).right_);
+
+  for (Index cur = at(removed).parent_; cur != NIL; cur = at(cur).parent_)
+    --at(cur).sizeColor_;
+  --size_;
+
+  // Stuff for eraseFixup.
+  bool toCheckRed = isRed(del);
+  Index toFix = NIL;
+  Index toFixParent = NIL;
+
+  if (at(del).left_ == NIL || at(del).right_ == NIL)
+  {
+    toFix = at(del).left_ == NIL ? at(del).right_ : at(del).left_;
+    toFixParent = at(del).parent_;
+    transplant(del, toFix);
+  }
+  else
+  {
+    Index next = removed;
+    toCheckRed = isRed(next);
+
+    toFixParent = next;
+    toFix = at(next).right_;
+
+    if (at(next).parent_ != del)
+    {
+      toFixParent = at(next).parent_;
+      transplant(next, at(next).right_);
+      at(next).right_ = at(del).right_;
+      at(at(next).right_).parent_ = next;
+    }
+
+    transplant(del, next);
+    at(next).left_ = at(del).left_;
+    at(at(next).left_).parent_ = next;
+    // Size and color are taken from del.
+    at(next).sizeColor_ = at(del).sizeColor_;
+  }
+
+  if (!toCheckRed)
+    eraseFixup(toFix, toFixParent);
+
+  at(del).left_ = free_;
+  free_ = del;
+}
+
+template <class Data, class Compare, class Allocator>
+void CompactStatTree<Data, Compare, Allocator>::transplant(Index old, Index replacing) noexcept
+{
+  Index parent = at(old).parent_;
+  if (parent == NIL)
+    root_ = replacing;
+  else if (at(parent).left_ == old)
+    at(parent).left_ = replacing;
+  else
+    at(parent).right_ = replacing;
+  if (replacing != NIL)
+    at(replacing).parent_ = parent;
+}
+
+template <class Data, class Compare, class Allocator>
+void CompactStatTree<Data, Compare, Allocator>::lRotation(Index idx) noexcept
+{
+  Index right = at(idx).right_;
+
+  at(idx).right_ = at(right).left_;
+  if (at(right).left_ != NIL)
+    at(at(right).left_).parent_ = idx;
+
+  transplant(idx, right);
+
+  at(right).left_ = idx;
+  at(idx).parent_ = right;
+
+  setSize(right, getSize(idx));
+  updateSize(idx);
+}
+
+template <class Data, class Compare, class Allocator>
+void CompactStatTree<Data, Compare, Allocator>::rRotation(Index idx) noexcept
+{
+  Index left = at(idx).left_;
+
+  at(idx).left_ = at(left).right_;
+  if (at(left).right_ != NIL)
+    at(at(left).right_).parent_ = idx;
+
+  transplant(idx, left);
+
+  at(left).right_ = idx;
+  at(idx).parent_ = left;
+
+  setSize(left, getSize(idx));
+  updateSize(idx);
+}
+
+template <class Data, class Compare, class Allocator>
+void CompactStatTree<Data, Compare, Allocator>::insertFixup(Index idx) noexcept
+{
+  while (isRed(at(idx).parent_))
+  {
+    Index parent = at(idx).parent_;
+    Index grand = at(parent).parent_;
+    bool parentIsLeft = parent == at(grand).left_;
+    Index uncle = parentIsLeft ? at(grand).right_ : at(grand).left_;
+
+    if (isRed(uncle))
+    {
+      setRed(parent, false);
+      setRed(uncle, false);
+      setRed(grand, true);
+      idx = grand;
+      continue;
+    }
+
+    if (parentIsLeft)
+    {
+      if (idx == at(parent).right_)
+      {
+        idx = parent;
+        lRotation(idx);
+      }
+      setRed(at(idx).parent_, false);
+      setRed(grand, true);
+      rRotation(grand);
+    }
+    else
+    {
+      if (idx == at(parent).left_)
+      {
+        idx = parent;
+        rRotation(idx);
+      }
+      setRed(at(idx).parent_, false);
+      setRed(grand, true);
+      lRotation(grand);
+    }
+  }
+
+  setRed(root_, false);
+}
+
+template <class Data, class Compare, class Allocator>
+void CompactStatTree<Data, Compare, Allocator>::eraseFixup(Index toFix, Index toFixParent) noexcept
+{
+  while (toFix != root_ && !isRed(toFix))
+  {
+    // Same as StatTree::eraseFixup with sides renaming.
+    bool isLeft = toFix == at(toFixParent).left_;
+    auto near = [this, isLeft](Index idx) { return isLeft ? at(idx).left_ : at(idx).right_; };
+    auto far = [this, isLeft](Index idx) { return isLeft ? at(idx).right_ : at(idx).left_; };
+    auto rotateNear = [this, isLeft](Index idx) { isLeft ? lRotation(idx) : rRotation(idx); };
+    auto rotateFar = [this, isLeft](Index idx) { isLeft ? rRotation(idx) : lRotation(idx); };
+
+    // Not nil because of black depth invariant compliance.
+    Index brother = far(toFixParent);
+    if (isRed(brother))
+    {
+      setRed(brother, false);
+      setRed(toFixParent, true);
+      rotateNear(toFixParent);
+
+      brother = far(toFixParent);
+    }
+    if (!isRed(at(brother).left_) && !isRed(at(brother).right_))
+    {
+      setRed(brother, true);
+      toFix = toFixParent;
+      toFixParent = at(toFix).parent_;
+    }
+    else
+    {
+      if (!isRed(far(brother)))
+      {
+        setRed(near(brother), false);
+        setRed(brother, true);
+        rotateFar(brother);
+
+        brother = far(toFixParent);
+      }
+
+      setRed(brother, isRed(toFixParent));
+      setRed(toFixParent, false);
+      setRed(far(brother), false);
+      rotateNear(toFixParent);
+
+      toFix = root_;
+    }
+  }
+
+  // Nil in case of the last node erasing.
+  if (toFix != NIL)
+    setRed(toFix, false);
+}
+
+} // namespace tree
+
+#endif // #ifndef COMPACT_TREE_IMPL_HH_INCL
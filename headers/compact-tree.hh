@@ -0,0 +1,275 @@
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tree.hh"
+
+#ifndef COMPACT_TREE_HH_INCL
+#define COMPACT_TREE_HH_INCL
+
+namespace tree
+{
+
+// Same RB tree as StatTree with compact node storage: nodes live in one vector
+// and are linked with 32-bit indices, color is packed into the highest bit of
+// the single sub tree size. Node overhead is 16 bytes instead of 48, so it
+// suits big trees of small keys. Holds up to 2^31 - 1 elements.
+// Erased nodes are reused by later inserts, their data is overwritten then, so
+// Data has to be trivially copyable: erased elements own no resources.
+template <class Data, class Compare = std::less<Data>, class Allocator = std::allocator<Data>>
+class CompactStatTree
+{
+  static_assert(std::is_trivially_copyable_v<Data>, "CompactStatTree keeps erased elements in reusable nodes");
+
+  friend struct TreeTester;
+
+  using Index = uint32_t;
+  static constexpr Index NIL = std::numeric_limits<Index>::max();
+
+  static constexpr uint32_t RED_BIT = uint32_t{1} << 31;
+  static constexpr uint32_t SIZE_MASK = RED_BIT - 1;
+
+  struct Node
+  {
+    Data data_;
+
+    Index left_ = NIL;
+    Index right_ = NIL;
+    Index parent_ = NIL;
+
+    // Sub tree size with the color in the highest bit.
+    uint32_t sizeColor_ = RED_BIT | 1;
+
+    template <class... Args>
+    explicit Node(std::in_place_t, Args &&...args) : data_(std::forward<Args>(args)...)
+    {}
+  };
+
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+  std::vector<Node, NodeAllocator> nodes_;
+
+  Index root_ = NIL;
+  // Erased nodes list linked through left_.
+  Index free_ = NIL;
+  size_t size_ = 0;
+
+  [[no_unique_address]] Compare comp_{};
+
+public:
+  class Iterator
+  {
+    friend CompactStatTree;
+
+    Index idx_ = NIL;
+    const CompactStatTree *tree_ = nullptr;
+
+    Iterator(Index idx, const CompactStatTree *tree) : idx_{idx}, tree_{tree}
+    {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Data;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Data *;
+    using reference = const Data &;
+
+    Iterator() = default;
+
+    const Data &operator*() const noexcept
+    {
+      return tree_->nodes_[idx_].data_;
+    }
+
+    const Data *operator->() const noexcept
+    {
+      return &tree_->nodes_[idx_].data_;
+    }
+
+    Iterator &operator++() noexcept
+    {
+      idx_ = tree_->getNext(idx_);
+      return *this;
+    }
+
+    Iterator operator++(int) noexcept
+    {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    Iterator &operator--() noexcept
+    {
+      idx_ = idx_ == NIL ? tree_->getRightmost(tree_->root_) : tree_->getPrev(idx_);
+      return *this;
+    }
+
+    Iterator operator--(int) noexcept
+    {
+      Iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    bool operator==(const Iterator &sd) const noexcept
+    {
+      return idx_ == sd.idx_;
+    }
+  };
+
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+
+  CompactStatTree() = default;
+
+  explicit CompactStatTree(const Compare &comp, const Allocator &alloc = Allocator{})
+    : nodes_{NodeAllocator{alloc}}, comp_{comp}
+  {}
+
+  Iterator begin() const noexcept
+  {
+    return Iterator{root_ == NIL ? NIL : getLeftmost(root_), this};
+  }
+
+  Iterator end() const noexcept
+  {
+    return Iterator{NIL, this};
+  }
+
+  size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  bool empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  // Preallocates memory for n nodes.
+  void reserve(size_t n)
+  {
+    nodes_.reserve(n);
+  }
+
+  void clear() noexcept
+  {
+    nodes_.clear();
+    root_ = free_ = NIL;
+    size_ = 0;
+  }
+
+  Iterator find(const Data &key) const
+  {
+    return find<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator find(const Key &key) const;
+
+  Iterator lower_bound(const Data &key) const
+  {
+    return lower_bound<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator lower_bound(const Key &key) const;
+
+  std::pair<Iterator, bool> insert(const Data &data);
+
+  void erase(Iterator delIt);
+
+  // Number of elements less than key.
+  size_t rank(const Data &key) const
+  {
+    return rank<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t rank(const Key &key) const;
+
+  // Element with k elements before it (k is zero based), end() if k >= size().
+  Iterator select(size_t k) const;
+
+private:
+  Node &at(Index idx) noexcept
+  {
+    return nodes_[idx];
+  }
+  const Node &at(Index idx) const noexcept
+  {
+    return nodes_[idx];
+  }
+
+  bool isRed(Index idx) const noexcept
+  {
+    return idx != NIL && (at(idx).sizeColor_ & RED_BIT) != 0;
+  }
+
+  void setRed(Index idx, bool red) noexcept
+  {
+    if (red)
+      at(idx).sizeColor_ |= RED_BIT;
+    else
+      at(idx).sizeColor_ &= SIZE_MASK;
+  }
+
+  uint32_t getSize(Index idx) const noexcept
+  {
+    if (idx == NIL)
+      return 0;
+    return at(idx).sizeColor_ & SIZE_MASK;
+  }
+
+  void setSize(Index idx, uint32_t size) noexcept
+  {
+    at(idx).sizeColor_ = (at(idx).sizeColor_ & RED_BIT) | size;
+  }
+
+  void updateSize(Index idx) noexcept
+  {
+    setSize(idx, getSize(at(idx).left_) + getSize(at(idx).right_) + 1);
+  }
+
+  Index getLeftmost(Index idx) const noexcept
+  {
+    while (at(idx).left_ != NIL)
+      idx = at(idx).left_;
+    return idx;
+  }
+
+  Index getRightmost(Index idx) const noexcept
+  {
+    while (at(idx).right_ != NIL)
+      idx = at(idx).right_;
+    return idx;
+  }
+
+  Index getNext(Index idx) const noexcept;
+  Index getPrev(Index idx) const noexcept;
+
+  // Takes node from the erased list or appends new one.
+  Index allocate(const Data &data);
+
+  template <class Key>
+  Index lowerBoundNode(const Key &key) const;
+
+  void transplant(Index old, Index replacing) noexcept;
+  void lRotation(Index idx) noexcept;
+  void rRotation(Index idx) noexcept;
+
+  void insertFixup(Index idx) noexcept;
+  void eraseFixup(Index toFix, Index toFixParent) noexcept;
+};
+
+} // namespace tree
+
+#include "compact-tree-impl.hh"
+
+#endif // #ifndef COMPACT_TREE_HH_INCL
@@ -0,0 +1,323 @@
+
+#include "concurrent-tree.hh"
+
+#ifndef CONCURRENT_TREE_IMPL_HH_INCL
+#define CONCURRENT_TREE_IMPL_HH_INCL
+
+namespace tree
+{
+
+template <class Data, class Compare, class Allocator>
+template <class TryRead>
+void ConcurrentStatTree<Data, Compare, Allocator>::read(TryRead tryRead) const
+{
+  for (size_t tries = 0; tries < MAX_OPTIMISTIC_TRIES; ++tries)
+  {
+    uint64_t seq = seq_.load(std::memory_order_acquire);
+    if (seq % 2 != 0)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    bool finished = tryRead();
+    // Loads of tryRead can't be moved after the check.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (finished && seq_.load(std::memory_order_relaxed) == seq)
+      return;
+  }
+
+  std::lock_guard lock{writeMutex_};
+  tryRead();
+}
+
+template <class Data, class Compare, class Allocator>
+template <class Modify>
+void ConcurrentStatTree<Data, Compare, Allocator>::write(Modify modify)
+{
+  struct Section
+  {
+    std::atomic<uint64_t> &seq_;
+    uint64_t start_;
+
+    explicit Section(std::atomic<uint64_t> &seq) : seq_{seq}, start_{seq.load(std::memory_order_relaxed)}
+    {
+      seq_.store(start_ + 1, std::memory_order_relaxed);
+      // Stores of modify can't be moved before the counter becomes odd.
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    ~Section()
+    {
+      seq_.store(start_ + 2, std::memory_order_release);
+    }
+  };
+
+  Section section{seq_};
+  modify();
+}
+
+template <class Data, class Compare, class Allocator>
+template <class Key>
+bool ConcurrentStatTree<Data, Compare, Allocator>::lowerBound(const Key &key, const Node *&bound) const
+{
+  bound = nullptr;
+  const Node *cur = load(tree_.root_);
+
+  for (size_t depth = 0; cur != nullptr; ++depth)
+  {
+    if (depth == MAX_DEPTH)
+      return false;
+
+    Data data = cur->data_;
+    if (tree_.comp_(data, key))
+      cur = load(cur->right_);
+    else
+    {
+      bound = cur;
+      cur = load(cur->left_);
+    }
+  }
+
+  return true;
+}
+
+template <class Data, class Compare, class Allocator>
+template <class Key>
+bool ConcurrentStatTree<Data, Compare, Allocator>::countBefore(const Key &key, bool inclusive, size_t &count) const
+{
+  count = 0;
+  const Node *cur = load(tree_.root_);
+
+  for (size_t depth = 0; cur != nullptr; ++depth)
+  {
+    if (depth == MAX_DEPTH)
+      return false;
+
+    Data data = cur->data_;
+    if (inclusive ? !tree_.comp_(key, data) : tree_.comp_(data, key))
+    {
+      count += load(cur->leftSize_) + 1;
+      cur = load(cur->right_);
+    }
+    else
+      cur = load(cur->left_);
+  }
+
+  return true;
+}
+
+template <class Data, class Compare, class Allocator>
+bool ConcurrentStatTree<Data, Compare, Allocator>::next(const Node *&node) const
+{
+  const Node *right = load(node->right_);
+  if (right != nullptr)
+  {
+    node = right;
+    for (size_t depth = 0; (right = load(node->left_)) != nullptr; ++depth)
+    {
+      if (depth == MAX_DEPTH)
+        return false;
+      node = right;
+    }
+    return true;
+  }
+
+  for (size_t depth = 0;; ++depth)
+  {
+    if (depth == MAX_DEPTH)
+      return false;
+
+    const Node *parent = load(node->parent_);
+    if (parent == nullptr || node != load(parent->right_))
+    {
+      node = parent;
+      return true;
+    }
+    node = parent;
+  }
+}
+
+template <class Data, class Compare, class Allocator>
+bool ConcurrentStatTree<Data, Compare, Allocator>::scanChunk(const std::optional<Data> &after,
+                                                              std::vector<Data> &chunk) const
+{
+  chunk.clear();
+
+  const Node *cur = load(tree_.leftmost_);
+  if (after.has_value())
+  {
+    // Upper bound of the last passed element.
+    cur = nullptr;
+    const Node *node = load(tree_.root_);
+    for (size_t depth = 0; node != nullptr; ++depth)
+    {
+      if (depth == MAX_DEPTH)
+        return false;
+
+      Data data = node->data_;
+      if (tree_.comp_(*after, data))
+      {
+        cur = node;
+        node = load(node->left_);
+      }
+      else
+        node = load(node->right_);
+    }
+  }
+
+  for (; cur != nullptr && chunk.size() < SCAN_CHUNK;)
+  {
+    chunk.push_back(cur->data_);
+    if (!next(cur))
+      return false;
+  }
+
+  return true;
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+std::optional<Data> ConcurrentStatTree<Data, Compare, Allocator>::find(const Key &key) const
+{
+  std::optional<Data> found{};
+  read([&] {
+    found.reset();
+
+    const Node *bound = nullptr;
+    if (!lowerBound(key, bound))
+      return false;
+
+    if (bound != nullptr)
+    {
+      Data data = bound->data_;
+      if (!tree_.comp_(key, data))
+        found = data;
+    }
+    return true;
+  });
+
+  return found;
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+size_t ConcurrentStatTree<Data, Compare, Allocator>::rank(const Key &key) const
+{
+  size_t count = 0;
+  read([&] { return countBefore(key, false, count); });
+  return count;
+}
+
+template <class Data, class Compare, class Allocator>
+std::optional<Data> ConcurrentStatTree<Data, Compare, Allocator>::select(size_t k) const
+{
+  std::optional<Data> selected{};
+  read([&] {
+    selected.reset();
+    if (k >= load(tree_.size_))
+      return true;
+
+    const Node *cur = load(tree_.root_);
+    for (size_t depth = 0, order = k; cur != nullptr && depth != MAX_DEPTH; ++depth)
+    {
+      size_t leftSize = load(cur->leftSize_);
+      if (order == leftSize)
+      {
+        selected = cur->data_;
+        return true;
+      }
+
+      if (order < leftSize)
+        cur = load(cur->left_);
+      else
+      {
+        order -= leftSize + 1;
+        cur = load(cur->right_);
+      }
+    }
+
+    // Sizes did not match the tree.
+    return false;
+  });
+
+  return selected;
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+size_t ConcurrentStatTree<Data, Compare, Allocator>::countInRange(const KeyLo &lo, const KeyHi &hi) const
+{
+  size_t count = 0;
+  read([&] {
+    size_t notGreater = 0;
+    size_t less = 0;
+    if (!countBefore(hi, true, notGreater) || !countBefore(lo, false, less))
+      return false;
+
+    count = notGreater > less ? notGreater - less : 0;
+    return true;
+  });
+
+  return count;
+}
+
+template <class Data, class Compare, class Allocator>
+template <class Func>
+void ConcurrentStatTree<Data, Compare, Allocator>::forEach(Func func) const
+{
+  std::vector<Data> chunk{};
+  chunk.reserve(SCAN_CHUNK);
+
+  for (std::optional<Data> last{};;)
+  {
+    read([&] { return scanChunk(last, chunk); });
+
+    for (const Data &data : chunk)
+      func(data);
+
+    if (chunk.size() < SCAN_CHUNK)
+      return;
+    last = chunk.back();
+  }
+}
+
+template <class Data, class Compare, class Allocator>
+bool ConcurrentStatTree<Data, Compare, Allocator>::insert(const Data &data)
+{
+  std::lock_guard lock{writeMutex_};
+
+  // Search and allocation don't change the tree, so readers are not disturbed.
+  auto pos = tree_.findInsertPos(data);
+  if (pos.equal_ != nullptr)
+    return false;
+
+  Node *node = tree_.pool_.create(std::in_place, data);
+  write([&] { tree_.insertNode(node, pos); });
+  return true;
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+bool ConcurrentStatTree<Data, Compare, Allocator>::erase(const Key &key)
+{
+  std::lock_guard lock{writeMutex_};
+
+  auto found = tree_.find(key);
+  if (found == tree_.end())
+    return false;
+
+  write([&] { tree_.erase(found); });
+  return true;
+}
+
+template <class Data, class Compare, class Allocator>
+void ConcurrentStatTree<Data, Compare, Allocator>::clear()
+{
+  std::lock_guard lock{writeMutex_};
+  write([&] { tree_.clear(); });
+}
+
+} // namespace tree
+
+#endif // #ifndef CONCURRENT_TREE_IMPL_HH_INCL
@@ -0,0 +1,166 @@
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "tree.hh"
+
+#ifndef CONCURRENT_TREE_HH_INCL
+#define CONCURRENT_TREE_HH_INCL
+
+namespace tree
+{
+
+// StatTree for many readers and few writers. Writers are serialized by the mutex
+// and keep the sequence counter odd while they relink nodes. Readers take no locks:
+// they traverse the tree optimistically and retry if the counter has changed
+// meanwhile (seqlock), so reads scale with cores and don't slow writers down.
+// Reader may meet the tree in the middle of a modification, so it relies on:
+//  - links and sizes are stored with release and loaded with acquire atomics
+//    (PublishedLinks), so a reader that reaches a node sees it constructed;
+//  - erased nodes are never reused and their memory is not returned to Allocator
+//    while the tree lives, so every pointer read is nullptr or points to some node
+//    and elements are never written after they are published;
+//  - Data is trivially copyable, so an erased element is not destroyed for real;
+//  - descents are limited by MAX_DEPTH steps, so cycles that rotations make for
+//    a moment can't hold a reader.
+// So memory of erased elements is taken back only by the tree destruction.
+// Reader that fails MAX_OPTIMISTIC_TRIES times in a row takes the mutex, so it
+// doesn't starve under a stream of writes.
+template <class Data, class Compare = std::less<Data>, class Allocator = std::allocator<Data>>
+class ConcurrentStatTree
+{
+  static_assert(std::is_trivially_copyable_v<Data>, "ConcurrentStatTree readers copy elements without locks");
+
+  using Tree = StatTree<Data, Compare, Allocator, NoAggregate, NoStats, PublishedLinks>;
+  using Node = typename Tree::Node;
+
+  // RB tree height is at most 2 log2 (n + 1).
+  static constexpr size_t MAX_DEPTH = 2 * std::numeric_limits<size_t>::digits;
+  static constexpr size_t MAX_OPTIMISTIC_TRIES = 64;
+  // Elements copied by forEach in one optimistic pass.
+  static constexpr size_t SCAN_CHUNK = 64;
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  // Readers only load the counter, so it has its own cache line.
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> seq_{0};
+  alignas(CACHE_LINE_SIZE) mutable std::mutex writeMutex_{};
+  Tree tree_;
+
+public:
+  ConcurrentStatTree() = default;
+
+  explicit ConcurrentStatTree(const Compare &comp, const Allocator &alloc = Allocator{}) : tree_{comp, alloc}
+  {}
+
+  ConcurrentStatTree(const ConcurrentStatTree &) = delete;
+  ConcurrentStatTree &operator=(const ConcurrentStatTree &) = delete;
+
+  size_t size() const
+  {
+    size_t size = 0;
+    read([&] {
+      size = load(tree_.size_);
+      return true;
+    });
+    return size;
+  }
+
+  bool empty() const
+  {
+    return size() == 0;
+  }
+
+  // Copy of the element equal to key.
+  std::optional<Data> find(const Data &key) const
+  {
+    return find<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  std::optional<Data> find(const Key &key) const;
+
+  bool contains(const Data &key) const
+  {
+    return find(key).has_value();
+  }
+  template <LookupKey<Data, Compare> Key>
+  bool contains(const Key &key) const
+  {
+    return find(key).has_value();
+  }
+
+  // Number of elements less than key.
+  size_t rank(const Data &key) const
+  {
+    return rank<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t rank(const Key &key) const;
+
+  // Copy of the element with k elements before it (k is zero based).
+  std::optional<Data> select(size_t k) const;
+
+  // Number of elements in [lo, hi], both bounds are counted at the same moment.
+  size_t countInRange(const Data &lo, const Data &hi) const
+  {
+    return countInRange<Data, Data>(lo, hi);
+  }
+  template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+  size_t countInRange(const KeyLo &lo, const KeyHi &hi) const;
+
+  // Calls func (const Data &) for all elements in order. Elements are copied by
+  // SCAN_CHUNK consistent pieces, so concurrent writes may be seen partially,
+  // but no element is passed twice or out of order.
+  template <class Func>
+  void forEach(Func func) const;
+
+  // Return 'true' if the tree has been changed.
+  bool insert(const Data &data);
+  bool erase(const Data &key)
+  {
+    return erase<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  bool erase(const Key &key);
+
+  void clear();
+
+private:
+  // Link or size that may be concurrently written, with the node it points to.
+  template <class T>
+  static T load(const T &field) noexcept
+  {
+    return std::atomic_ref<T>{const_cast<T &>(field)}.load(std::memory_order_acquire);
+  }
+
+  // Runs tryRead until it succeeds on the unchanged tree. tryRead returns 'false'
+  // if it has met an inconsistent tree.
+  template <class TryRead>
+  void read(TryRead tryRead) const;
+
+  // Runs modify as one write section.
+  template <class Modify>
+  void write(Modify modify);
+
+  // Optimistic traversals, return 'false' if they have not finished in time.
+  template <class Key>
+  bool lowerBound(const Key &key, const Node *&bound) const;
+  template <class Key>
+  bool countBefore(const Key &key, bool inclusive, size_t &count) const;
+  bool next(const Node *&node) const;
+  bool scanChunk(const std::optional<Data> &after, std::vector<Data> &chunk) const;
+};
+
+} // namespace tree
+
+#include "concurrent-tree-impl.hh"
+
+#endif // #ifndef CONCURRENT_TREE_HH_INCL
@@ -0,0 +1,197 @@
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "tree-io.hh"
+#include "tree-tester.hh"
+
+#ifndef DIFF_CHECKER_HH_INCL
+#define DIFF_CHECKER_HH_INCL
+
+namespace tree
+{
+
+// Applies ops to StatTree and StatMultiset and to std::set and std::multiset
+// references, compares every answer and checks all tree invariants every
+// checkPeriod ops. Inserts and erases of the multiset add and remove one copy.
+class DiffChecker
+{
+  TreeTester::TestTree tree_{};
+  std::set<size_t> treeRef_{};
+  TreeTester::MultisetTestTree multiset_{};
+  std::multiset<size_t> multisetRef_{};
+
+  const size_t checkPeriod_;
+  size_t opsNum_ = 0;
+  std::string failure_{};
+
+public:
+  // Keys of decoded records are taken modulo this, so that keys repeat.
+  static constexpr uint32_t DECODED_KEYS_NUM = 1 << 10;
+
+  explicit DiffChecker(size_t checkPeriod) : checkPeriod_{std::max<size_t>(checkPeriod, 1)}
+  {}
+
+  // Takes the next op from bytes: records of io::BINARY_RECORD_SIZE bytes, op code
+  // byte and little endian key, any byte string is valid. Returns 'false' when
+  // bytes are over.
+  static bool decode(std::string_view &bytes, io::Op &op) noexcept
+  {
+    static constexpr size_t OP_CODES_NUM = static_cast<size_t>(io::OpCode::SELECT) + 1;
+
+    if (bytes.size() < io::BINARY_RECORD_SIZE)
+      return false;
+
+    uint32_t key = 0;
+    for (size_t i = io::BINARY_RECORD_SIZE - 1; i > 0; --i)
+      key = key << 8 | static_cast<uint8_t>(bytes[i]);
+
+    op.code_ = static_cast<io::OpCode>(static_cast<uint8_t>(bytes[0]) % OP_CODES_NUM);
+    op.key_ = static_cast<int>(key % DECODED_KEYS_NUM);
+    bytes.remove_prefix(io::BINARY_RECORD_SIZE);
+    return true;
+  }
+
+  // Returns 'false' if answers differ or invariants are broken, failure ()
+  // tells what happened.
+  bool apply(const io::Op &op);
+
+  // Checks invariants and compares whole contents.
+  bool check();
+
+  const std::string &failure() const noexcept
+  {
+    return failure_;
+  }
+
+private:
+  template <class Answer, class Expected>
+  bool compare(const char *what, const Answer &answer, const Expected &expected)
+  {
+    if (answer == expected)
+      return true;
+
+    std::ostringstream out{};
+    out << what << ": " << answer << " instead of " << expected;
+    failure_ = out.str();
+    return false;
+  }
+
+  // Number of reference elements less than key.
+  template <class Reference>
+  static size_t rankRef(const Reference &reference, size_t key)
+  {
+    return static_cast<size_t>(std::distance(reference.begin(), reference.lower_bound(key)));
+  }
+
+  // Element of the reference with k elements before it, or end ().
+  template <class Reference>
+  static auto selectRef(const Reference &reference, size_t k)
+  {
+    return k >= reference.size() ? reference.end() : std::next(reference.begin(), static_cast<std::ptrdiff_t>(k));
+  }
+};
+
+inline bool DiffChecker::apply(const io::Op &op)
+{
+  // Keys are non negative in the tree and in the references alike.
+  size_t key = static_cast<uint32_t>(op.key_);
+
+  switch (op.code_)
+  {
+  case io::OpCode::INSERT:
+    if (!compare("set insert", tree_.insert(key).second, treeRef_.insert(key).second))
+      return false;
+    multiset_.insert(key);
+    multisetRef_.insert(key);
+    break;
+  case io::OpCode::ERASE: {
+    if (!compare("set erase", tree_.erase(key), treeRef_.erase(key)))
+      return false;
+    auto refIt = multisetRef_.find(key);
+    if (!compare("multiset erase", multiset_.eraseOne(key), refIt == multisetRef_.end() ? size_t{0} : size_t{1}))
+      return false;
+    if (refIt != multisetRef_.end())
+      multisetRef_.erase(refIt);
+    break;
+  }
+  case io::OpCode::FIND:
+    if (!compare("set find", tree_.find(key) != tree_.end(), treeRef_.contains(key)) ||
+        !compare("multiset count", multiset_.count(key), multisetRef_.count(key)))
+      return false;
+    break;
+  case io::OpCode::RANK:
+    if (!compare("set rank", tree_.rank(key), rankRef(treeRef_, key)) ||
+        !compare("multiset rank", multiset_.rank(key), rankRef(multisetRef_, key)))
+      return false;
+    break;
+  case io::OpCode::SELECT: {
+    // Mostly valid positions, and the end as well.
+    auto setIt = tree_.select(key % (tree_.size() + 1));
+    auto setRefIt = selectRef(treeRef_, key % (treeRef_.size() + 1));
+    if (!compare("set select end", setIt == tree_.end(), setRefIt == treeRef_.end()) ||
+        (setIt != tree_.end() && !compare("set select", setIt->value_, *setRefIt)))
+      return false;
+
+    auto multisetIt = multiset_.select(key % (multiset_.size() + 1));
+    auto multisetRefIt = selectRef(multisetRef_, key % (multisetRef_.size() + 1));
+    if (!compare("multiset select end", multisetIt == multiset_.end(), multisetRefIt == multisetRef_.end()) ||
+        (multisetIt != multiset_.end() && !compare("multiset select", multisetIt->data_, *multisetRefIt)))
+      return false;
+    break;
+  }
+  default:
+    failure_ = "unknown op code";
+    return false;
+  }
+
+  return ++opsNum_ % checkPeriod_ != 0 || check();
+}
+
+inline bool DiffChecker::check()
+{
+  if (!TreeTester::verify(tree_))
+  {
+    failure_ = "set invariants are broken";
+    return false;
+  }
+  if (!TreeTester::verify(multiset_))
+  {
+    failure_ = "multiset invariants are broken";
+    return false;
+  }
+
+  if (!compare("set size", tree_.size(), treeRef_.size()) ||
+      !compare("multiset size", multiset_.size(), multisetRef_.size()))
+    return false;
+
+  if (!std::equal(tree_.begin(), tree_.end(), treeRef_.begin(), treeRef_.end(),
+                  [](const auto &data, size_t key) { return data.value_ == key; }))
+  {
+    failure_ = "set contents differ";
+    return false;
+  }
+
+  auto refIt = multisetRef_.begin();
+  for (const auto &entry : multiset_)
+  {
+    size_t copies = multisetRef_.count(entry.data_);
+    if (refIt == multisetRef_.end() || *refIt != entry.data_ || copies != entry.count_)
+    {
+      failure_ = "multiset contents differ";
+      return false;
+    }
+    std::advance(refIt, static_cast<std::ptrdiff_t>(copies));
+  }
+  return true;
+}
+
+} // namespace tree
+
+#endif // #ifndef DIFF_CHECKER_HH_INCL
@@ -0,0 +1,215 @@
+
+#include "frozen-tree.hh"
+
+#ifndef FROZEN_TREE_IMPL_HH_INCL
+#define FROZEN_TREE_IMPL_HH_INCL
+
+namespace tree
+{
+
+template <class Data, class Compare>
+template <std::input_iterator It>
+FrozenStatTree<Data, Compare>::FrozenStatTree(It first, It last, const Compare &comp) : comp_{comp}
+{
+  auto arrays = std::make_shared<Arrays>();
+  arrays->sorted_.assign(first, last);
+
+  size_ = arrays->sorted_.size();
+  if (size_ >= std::numeric_limits<uint32_t>::max())
+    throw std::length_error{"FrozenStatTree: too many elements"};
+
+  if (size_ != 0)
+  {
+    arrays->ranks_.resize(slotsNum(size_));
+    uint32_t next = 0;
+    fillRanks(arrays->ranks_, 1, next);
+
+    // Slot 0 is not a node, it only keeps indices 1 based.
+    arrays->eytzinger_.reserve(slotsNum(size_));
+    arrays->eytzinger_.push_back(arrays->sorted_.front());
+    for (size_t k = 1; k < arrays->ranks_.size(); ++k)
+      arrays->eytzinger_.push_back(arrays->sorted_[arrays->ranks_[k]]);
+  }
+
+  sorted_ = arrays->sorted_.data();
+  eytzinger_ = arrays->eytzinger_.data();
+  ranks_ = arrays->ranks_.data();
+  storage_ = std::move(arrays);
+}
+
+template <class Data, class Compare>
+void FrozenStatTree<Data, Compare>::fillRanks(std::vector<uint32_t> &ranks, size_t k, uint32_t &next)
+{
+  if (k >= ranks.size())
+    return;
+
+  fillRanks(ranks, 2 * k, next);
+  ranks[k] = next++;
+  fillRanks(ranks, 2 * k + 1, next);
+}
+
+template <class Data, class Compare>
+typename FrozenStatTree<Data, Compare>::ImageLayout FrozenStatTree<Data, Compare>::imageLayout(size_t size) noexcept
+{
+  auto alignUp = [](size_t offset) { return (offset + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE; };
+
+  ImageLayout layout{};
+  layout.sorted_ = alignUp(sizeof(image::Header));
+  layout.eytzinger_ = alignUp(layout.sorted_ + size * sizeof(Data));
+  layout.ranks_ = alignUp(layout.eytzinger_ + slotsNum(size) * sizeof(Data));
+  layout.size_ = layout.ranks_ + slotsNum(size) * sizeof(uint32_t);
+  return layout;
+}
+
+template <class Data, class Compare>
+void FrozenStatTree<Data, Compare>::save(const std::string &path) const
+  requires std::is_trivially_copyable_v<Data>
+{
+  std::string_view sections[]{
+    {reinterpret_cast<const char *>(sorted_), size_ * sizeof(Data)},
+    {reinterpret_cast<const char *>(eytzinger_), slotsNum(size_) * sizeof(Data)},
+    {reinterpret_cast<const char *>(ranks_), slotsNum(size_) * sizeof(uint32_t)},
+  };
+
+  image::Header header{};
+  std::copy(image::MAGIC.begin(), image::MAGIC.end(), header.magic_);
+  header.keySize_ = sizeof(Data);
+  header.size_ = size_;
+  header.checksum_ = image::CHECKSUM_SEED;
+  for (auto section : sections)
+    header.checksum_ = image::checksum(section, header.checksum_);
+
+  std::ofstream out{path, std::ios::binary};
+  if (!out.is_open())
+    throw std::runtime_error{"can't open " + path};
+
+  ImageLayout layout = imageLayout(size_);
+  size_t offsets[]{layout.sorted_, layout.eytzinger_, layout.ranks_};
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  size_t written = sizeof(header);
+  for (size_t i = 0; i < std::size(sections); ++i)
+  {
+    const char padding[CACHE_LINE_SIZE]{};
+    out.write(padding, static_cast<std::streamsize>(offsets[i] - written));
+    out.write(sections[i].data(), static_cast<std::streamsize>(sections[i].size()));
+    written = offsets[i] + sections[i].size();
+  }
+
+  if (!out)
+    throw std::runtime_error{"can't write " + path};
+}
+
+template <class Data, class Compare>
+FrozenStatTree<Data, Compare> FrozenStatTree<Data, Compare>::load(const std::string &path, const Compare &comp)
+  requires std::is_trivially_copyable_v<Data>
+{
+  static_assert(alignof(Data) <= CACHE_LINE_SIZE, "image sections are aligned by cache lines only");
+
+  auto image = std::make_shared<image::MappedFile>(path);
+  std::string_view view = image->view();
+
+  image::Header header{};
+  if (view.size() < sizeof(header))
+    throw std::runtime_error{path + ": image header is truncated"};
+  std::memcpy(&header, view.data(), sizeof(header));
+
+  if (std::string_view{header.magic_, sizeof(header.magic_)} != image::MAGIC)
+    throw std::runtime_error{path + ": not a tree image"};
+  if (header.version_ != image::VERSION)
+    throw std::runtime_error{path + ": unsupported image version or byte order"};
+  if (header.keySize_ != sizeof(Data))
+    throw std::runtime_error{path + ": image keys are of other type"};
+  if (header.size_ >= std::numeric_limits<uint32_t>::max())
+    throw std::runtime_error{path + ": image size is damaged"};
+
+  size_t size = static_cast<size_t>(header.size_);
+  ImageLayout layout = imageLayout(size);
+  if (view.size() != layout.size_)
+    throw std::runtime_error{path + ": image size does not match its header"};
+
+  uint64_t checksum = image::CHECKSUM_SEED;
+  checksum = image::checksum(view.substr(layout.sorted_, size * sizeof(Data)), checksum);
+  checksum = image::checksum(view.substr(layout.eytzinger_, slotsNum(size) * sizeof(Data)), checksum);
+  checksum = image::checksum(view.substr(layout.ranks_, slotsNum(size) * sizeof(uint32_t)), checksum);
+  if (checksum != header.checksum_)
+    throw std::runtime_error{path + ": image checksum mismatch"};
+
+  // Mapping is page aligned, so are the sections.
+  FrozenStatTree tree{};
+  tree.comp_ = comp;
+  tree.size_ = size;
+  tree.sorted_ = reinterpret_cast<const Data *>(view.data() + layout.sorted_);
+  tree.eytzinger_ = reinterpret_cast<const Data *>(view.data() + layout.eytzinger_);
+  tree.ranks_ = reinterpret_cast<const uint32_t *>(view.data() + layout.ranks_);
+  tree.storage_ = std::move(image);
+  return tree;
+}
+
+template <class Data, class Compare>
+template <class Key>
+size_t FrozenStatTree<Data, Compare>::searchSlot(const Key &key, bool inclusive) const
+{
+  const Data *keys = eytzinger_;
+  size_t size = size_;
+
+  size_t k = 1;
+  while (k <= size)
+  {
+    // Descendants of k PREFETCH_STRIDE levels below start here, prefetch does not fault.
+    __builtin_prefetch(keys + std::min(k * PREFETCH_STRIDE, size));
+    bool before = inclusive ? !comp_(key, keys[k]) : comp_(keys[k], key);
+    k = 2 * k + (before ? 1 : 0);
+  }
+
+  // Right turns after the last left one are dropped, the node of that turn is the answer.
+  return k >> (std::countr_one(k) + 1);
+}
+
+template <class Data, class Compare>
+template <LookupKey<Data, Compare> Key>
+size_t FrozenStatTree<Data, Compare>::rank(const Key &key) const
+{
+  size_t slot = searchSlot(key, false);
+  return slot == 0 ? size() : ranks_[slot];
+}
+
+template <class Data, class Compare>
+template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+size_t FrozenStatTree<Data, Compare>::countInRange(const KeyLo &lo, const KeyHi &hi) const
+{
+  size_t slot = searchSlot(hi, true);
+  size_t notGreater = slot == 0 ? size() : ranks_[slot];
+  size_t less = rank(lo);
+  return notGreater > less ? notGreater - less : 0;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+FrozenStatTree<Data, Compare> StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::freeze() const
+{
+  return FrozenStatTree<Data, Compare>{begin(), end(), comp_};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::save(const std::string &path) const
+  requires std::is_trivially_copyable_v<Data>
+{
+  freeze().save(path);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+StatTree<Data, Compare, Allocator, Aggregate, Stats, Links> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::load(const std::string &path, const Compare &comp,
+                                                        const Allocator &alloc)
+  requires std::is_trivially_copyable_v<Data>
+{
+  auto frozen = FrozenStatTree<Data, Compare>::load(path, comp);
+
+  StatTree tree{comp, alloc};
+  tree.assignSorted(frozen.begin(), frozen.end());
+  return tree;
+}
+
+} // namespace tree
+
+#endif // #ifndef FROZEN_TREE_IMPL_HH_INCL
@@ -0,0 +1,195 @@
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "tree-image.hh"
+#include "tree.hh"
+
+#ifndef FROZEN_TREE_HH_INCL
+#define FROZEN_TREE_HH_INCL
+
+namespace tree
+{
+
+// Immutable order statistic tree without pointers, made by StatTree::freeze ().
+// Keys are stored twice: in sorted order for select and iteration and in Eytzinger
+// (BFS) order for searches together with their sorted positions. A descent is a
+// branchless loop k = 2k + (key_k < key) over one array, nodes of the next levels
+// are prefetched, so all cache misses of a search overlap. Takes
+// 2 sizeof (Data) + 4 bytes per element.
+// Arrays are shared by copies. They are either owned or mapped from an image file
+// written by save (), so load () gives a ready tree without building it.
+template <class Data, class Compare>
+class FrozenStatTree
+{
+  friend struct TreeTester;
+
+  // Nodes PREFETCH_LEVELS below the current one lie in one cache line (for small Data).
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  static constexpr size_t PREFETCH_STRIDE = std::bit_floor(std::max<size_t>(CACHE_LINE_SIZE / sizeof(Data), 1));
+
+  // Arrays of a built tree.
+  struct Arrays
+  {
+    std::vector<Data> sorted_{};
+    std::vector<Data> eytzinger_{};
+    std::vector<uint32_t> ranks_{};
+  };
+
+  // Offsets of image sections, each one starts at a cache line.
+  struct ImageLayout
+  {
+    size_t sorted_ = 0;
+    size_t eytzinger_ = 0;
+    size_t ranks_ = 0;
+    size_t size_ = 0;
+  };
+
+  // Arrays or mapped image.
+  std::shared_ptr<const void> storage_{};
+
+  // Sorted keys.
+  const Data *sorted_ = nullptr;
+  // Keys in Eytzinger order, 1 based: children of k are 2k and 2k + 1.
+  const Data *eytzinger_ = nullptr;
+  // Sorted positions of eytzinger_ keys.
+  const uint32_t *ranks_ = nullptr;
+  size_t size_ = 0;
+
+  [[no_unique_address]] Compare comp_{};
+
+public:
+  using Iterator = const Data *;
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+
+  FrozenStatTree() = default;
+
+  // Builds from sorted unique [first, last) in O(n).
+  template <std::input_iterator It>
+  FrozenStatTree(It first, It last, const Compare &comp = Compare{});
+
+  // Maps the image written by save (). Throws std::system_error if the file can't
+  // be mapped and std::runtime_error if it is not an image of this tree type or
+  // is damaged.
+  static FrozenStatTree load(const std::string &path, const Compare &comp = Compare{})
+    requires std::is_trivially_copyable_v<Data>;
+
+  // Writes the versioned image of arrays with their checksum.
+  void save(const std::string &path) const
+    requires std::is_trivially_copyable_v<Data>;
+
+  Iterator begin() const noexcept
+  {
+    return sorted_;
+  }
+
+  Iterator end() const noexcept
+  {
+    return sorted_ + size_;
+  }
+
+  size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  bool empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  Iterator find(const Data &key) const
+  {
+    return find<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator find(const Key &key) const
+  {
+    // Found key is checked in eytzinger_, so sorted_ is not touched before the result.
+    size_t slot = searchSlot(key, false);
+    if (slot == 0 || comp_(key, eytzinger_[slot]))
+      return end();
+    return begin() + ranks_[slot];
+  }
+
+  bool contains(const Data &key) const
+  {
+    return contains<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  bool contains(const Key &key) const
+  {
+    size_t slot = searchSlot(key, false);
+    return slot != 0 && !comp_(key, eytzinger_[slot]);
+  }
+
+  // First element not less than key.
+  Iterator lower_bound(const Data &key) const
+  {
+    return lower_bound<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator lower_bound(const Key &key) const
+  {
+    return begin() + rank(key);
+  }
+
+  // Number of elements less than key.
+  size_t rank(const Data &key) const
+  {
+    return rank<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t rank(const Key &key) const;
+
+  // Element with k elements before it (k is zero based), end() if k >= size().
+  Iterator select(size_t k) const noexcept
+  {
+    return k >= size() ? end() : begin() + k;
+  }
+
+  // Number of elements in [lo, hi].
+  size_t countInRange(const Data &lo, const Data &hi) const
+  {
+    return countInRange<Data, Data>(lo, hi);
+  }
+  template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+  size_t countInRange(const KeyLo &lo, const KeyHi &hi) const;
+
+private:
+  // Fills ranks of sub tree with root k by in-order pass, next is the sorted position.
+  static void fillRanks(std::vector<uint32_t> &ranks, size_t k, uint32_t &next);
+
+  // Eytzinger arrays have slot 0 unless the tree is empty.
+  static size_t slotsNum(size_t size) noexcept
+  {
+    return size == 0 ? 0 : size + 1;
+  }
+
+  static ImageLayout imageLayout(size_t size) noexcept;
+
+  // Eytzinger index of the first element not less than key (greater than key if
+  // inclusive), 0 if there is no such.
+  template <class Key>
+  size_t searchSlot(const Key &key, bool inclusive) const;
+};
+
+} // namespace tree
+
+#include "frozen-tree-impl.hh"
+
+#endif // #ifndef FROZEN_TREE_HH_INCL
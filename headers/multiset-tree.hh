@@ -0,0 +1,225 @@
+
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "tree.hh"
+
+#ifndef MULTISET_TREE_HH_INCL
+#define MULTISET_TREE_HH_INCL
+
+namespace tree
+{
+
+// Entry of StatMultiset: distinct key and the number of its copies.
+template <class Data>
+struct CountedKey
+{
+  Data data_;
+  size_t count_ = 1;
+};
+
+// Order statistic multiset. Equal keys share one StatTree node with multiplicity
+// counter, so memory and height depend on distinct keys only. Sub tree sums of
+// counters are node aggregates: rank, select and countInRange count copies, all
+// operations take O(log n) of distinct keys.
+template <class Data, class Compare = std::less<Data>, class Allocator = std::allocator<Data>>
+class StatMultiset
+{
+  friend struct TreeTester;
+
+  using Entry = CountedKey<Data>;
+
+  // Compares entries by keys, and with bare keys as well.
+  struct EntryLess
+  {
+    using is_transparent = void;
+
+    [[no_unique_address]] Compare comp_{};
+
+    bool operator()(const Entry &lhs, const Entry &rhs) const
+    {
+      return comp_(lhs.data_, rhs.data_);
+    }
+
+    template <class Key>
+      requires(!std::same_as<Key, Entry>)
+    bool operator()(const Entry &lhs, const Key &rhs) const
+    {
+      return comp_(lhs.data_, rhs);
+    }
+
+    template <class Key>
+      requires(!std::same_as<Key, Entry>)
+    bool operator()(const Key &lhs, const Entry &rhs) const
+    {
+      return comp_(lhs, rhs.data_);
+    }
+  };
+
+  struct CountOf
+  {
+    size_t operator()(const Entry &entry) const noexcept
+    {
+      return entry.count_;
+    }
+  };
+
+  using EntryAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Entry>;
+  using Tree = StatTree<Entry, EntryLess, EntryAllocator, SumAggregate<Entry, CountOf>>;
+
+  Tree tree_;
+
+public:
+  // Iterators pass distinct keys: it->data_ is the key, it->count_ is its multiplicity.
+  using Iterator = typename Tree::Iterator;
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+
+  StatMultiset() = default;
+
+  explicit StatMultiset(const Compare &comp, const Allocator &alloc = Allocator{})
+    : tree_{EntryLess{comp}, EntryAllocator{alloc}}
+  {}
+
+  Iterator begin() const noexcept
+  {
+    return tree_.begin();
+  }
+
+  Iterator end() const noexcept
+  {
+    return tree_.end();
+  }
+
+  // Number of elements with all copies.
+  size_t size() const noexcept
+  {
+    return tree_.aggregate();
+  }
+
+  // Number of distinct keys.
+  size_t distinct() const noexcept
+  {
+    return tree_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return tree_.empty();
+  }
+
+  // Adds count copies of data. Returns iterator to its entry.
+  Iterator insert(const Data &data, size_t count = 1)
+  {
+    if (count == 0)
+      return find(data);
+
+    auto [it, inserted] = tree_.insert(Entry{data, count});
+    if (!inserted)
+      tree_.modify(it, [count](Entry &entry) { entry.count_ += count; });
+    return it;
+  }
+
+  Iterator find(const Data &key) const
+  {
+    return find<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator find(const Key &key) const
+  {
+    return tree_.find(key);
+  }
+
+  // Number of copies of key.
+  size_t count(const Data &key) const
+  {
+    return count<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t count(const Key &key) const
+  {
+    Iterator it = find(key);
+    return it == end() ? 0 : it->count_;
+  }
+
+  // Number of elements less than key.
+  size_t rank(const Data &key) const
+  {
+    return rank<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t rank(const Key &key) const
+  {
+    return tree_.aggregateBefore(key);
+  }
+
+  // Entry of the element with k elements before it (k is zero based), end() if k >= size().
+  Iterator select(size_t k) const
+  {
+    return tree_.findPrefix([k](size_t prefix) { return prefix > k; });
+  }
+
+  // Number of elements in [lo, hi].
+  size_t countInRange(const Data &lo, const Data &hi) const
+  {
+    return countInRange<Data, Data>(lo, hi);
+  }
+  template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+  size_t countInRange(const KeyLo &lo, const KeyHi &hi) const
+  {
+    return tree_.aggregate(lo, hi);
+  }
+
+  // Erases one copy of key. Returns the number of erased elements.
+  size_t eraseOne(const Data &key)
+  {
+    return eraseOne<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t eraseOne(const Key &key)
+  {
+    Iterator it = find(key);
+    if (it == end())
+      return 0;
+
+    if (it->count_ == 1)
+      tree_.erase(it);
+    else
+      tree_.modify(it, [](Entry &entry) { --entry.count_; });
+    return 1;
+  }
+
+  // Erases all copies of key. Returns the number of erased elements.
+  size_t erase(const Data &key)
+  {
+    return erase<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t erase(const Key &key)
+  {
+    Iterator it = find(key);
+    if (it == end())
+      return 0;
+
+    size_t count = it->count_;
+    tree_.erase(it);
+    return count;
+  }
+
+  // Erases all copies of the entry.
+  void erase(Iterator pos)
+  {
+    tree_.erase(pos);
+  }
+
+  void clear() noexcept
+  {
+    tree_.clear();
+  }
+};
+
+} // namespace tree
+
+#endif // #ifndef MULTISET_TREE_HH_INCL
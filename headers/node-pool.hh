@@ -0,0 +1,258 @@
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifndef NODE_POOL_HH_INCL
+#define NODE_POOL_HH_INCL
+
+namespace tree
+{
+
+// Slab allocator for tree nodes. Nodes are carved from cache line aligned
+// chunks taken from Allocator and erased nodes are recycled through the free list.
+// Chunks are owned by refcounted arenas: nodes can migrate between trees (split,
+// join), so the pool of each such tree holds references to arenas of all nodes
+// it may get. Chunks are returned to Allocator when the last reference is dropped.
+// New chunks are added only to the own arena, so pools of different trees may be
+// used from different threads.
+template <class Node, class Allocator>
+class NodePool
+{
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  static constexpr size_t MIN_CHUNK_NODES = 64;
+  static constexpr size_t MAX_CHUNK_NODES = 1 << 16;
+
+  struct alignas(CACHE_LINE_SIZE) CacheLine
+  {
+    std::byte bytes_[CACHE_LINE_SIZE];
+  };
+
+  // Free slot stores the link to the next free one.
+  union Slot {
+    Slot *next_;
+    alignas(Node) std::byte storage_[sizeof(Node)];
+  };
+
+  using LineAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<CacheLine>;
+  using LineTraits = std::allocator_traits<LineAllocator>;
+
+  struct Chunk
+  {
+    CacheLine *lines_;
+    size_t linesNum_;
+  };
+
+  struct Arena
+  {
+    LineAllocator alloc_;
+    std::vector<Chunk> chunks_{};
+
+    explicit Arena(const LineAllocator &alloc) : alloc_{alloc}
+    {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+      for (auto &chunk : chunks_)
+        LineTraits::deallocate(alloc_, chunk.lines_, chunk.linesNum_);
+    }
+  };
+
+  [[no_unique_address]] LineAllocator alloc_;
+
+  // Arena for new chunks, created on demand.
+  std::shared_ptr<Arena> arena_{};
+  // Arenas of nodes came from other pools.
+  std::vector<std::shared_ptr<Arena>> shared_{};
+
+  Slot *freeList_ = nullptr;
+  Slot *freeTail_ = nullptr;
+  // Never used slots of the last chunk.
+  Slot *bumpCur_ = nullptr;
+  Slot *bumpEnd_ = nullptr;
+
+  // Free list length with bump slots.
+  size_t freeNum_ = 0;
+  size_t capacity_ = 0;
+
+public:
+  explicit NodePool(const Allocator &alloc = Allocator{}) : alloc_{alloc}
+  {}
+
+  NodePool(const NodePool &) = delete;
+  NodePool &operator=(const NodePool &) = delete;
+
+  NodePool(NodePool &&sd) noexcept : alloc_{sd.alloc_}
+  {
+    swap(sd);
+  }
+
+  NodePool &operator=(NodePool &&sd) = delete;
+
+  void swap(NodePool &sd) noexcept
+  {
+    using std::swap;
+    swap(alloc_, sd.alloc_);
+    swap(arena_, sd.arena_);
+    swap(shared_, sd.shared_);
+    swap(freeList_, sd.freeList_);
+    swap(freeTail_, sd.freeTail_);
+    swap(bumpCur_, sd.bumpCur_);
+    swap(bumpEnd_, sd.bumpEnd_);
+    swap(freeNum_, sd.freeNum_);
+    swap(capacity_, sd.capacity_);
+  }
+
+  Allocator get_allocator() const noexcept
+  {
+    return Allocator{alloc_};
+  }
+
+  template <class... Args>
+  Node *create(Args &&...args)
+  {
+    Slot *slot = takeSlot();
+    try
+    {
+      return ::new (static_cast<void *>(slot->storage_)) Node{std::forward<Args>(args)...};
+    }
+    catch (...)
+    {
+      putSlot(slot);
+      throw;
+    }
+  }
+
+  void destroy(Node *node) noexcept
+  {
+    node->~Node();
+    putSlot(reinterpret_cast<Slot *>(node));
+  }
+
+  // Destroys node without reusing its slot while the pool lives, so the memory
+  // stays as it was for lock free readers which may still hold the node.
+  void retire(Node *node) noexcept
+  {
+    node->~Node();
+  }
+
+  // Makes pool able to create n nodes without requests to Allocator.
+  void reserve(size_t n)
+  {
+    if (n > freeNum_)
+      addChunk(n - freeNum_);
+  }
+
+  // Number of slots in own chunks.
+  size_t capacity() const noexcept
+  {
+    return capacity_;
+  }
+
+  // Lets sd own nodes created by this pool.
+  void share(NodePool &sd)
+  {
+    sd.addShared(arena_);
+    for (auto &arena : shared_)
+      sd.addShared(arena);
+  }
+
+  // Takes ownership of nodes and free slots of sd.
+  void adopt(NodePool &sd)
+  {
+    sd.share(*this);
+
+    for (; sd.bumpCur_ != sd.bumpEnd_; ++sd.bumpCur_)
+    {
+      sd.putSlot(sd.bumpCur_);
+      --sd.freeNum_;
+    }
+
+    if (sd.freeList_ != nullptr)
+    {
+      sd.freeTail_->next_ = freeList_;
+      if (freeList_ == nullptr)
+        freeTail_ = sd.freeTail_;
+      freeList_ = sd.freeList_;
+      freeNum_ += sd.freeNum_;
+    }
+
+    sd.freeList_ = sd.freeTail_ = nullptr;
+    sd.freeNum_ = 0;
+  }
+
+private:
+  void addShared(const std::shared_ptr<Arena> &arena)
+  {
+    if (arena == nullptr || arena == arena_)
+      return;
+    if (std::find(std::begin(shared_), std::end(shared_), arena) == std::end(shared_))
+      shared_.push_back(arena);
+  }
+
+  Slot *takeSlot()
+  {
+    Slot *slot = freeList_;
+    if (slot != nullptr)
+    {
+      freeList_ = slot->next_;
+      if (freeList_ == nullptr)
+        freeTail_ = nullptr;
+    }
+    else
+    {
+      if (bumpCur_ == bumpEnd_)
+        addChunk(std::clamp(capacity_, MIN_CHUNK_NODES, MAX_CHUNK_NODES));
+      slot = bumpCur_++;
+    }
+
+    --freeNum_;
+    return slot;
+  }
+
+  void putSlot(Slot *slot) noexcept
+  {
+    slot->next_ = freeList_;
+    if (freeList_ == nullptr)
+      freeTail_ = slot;
+    freeList_ = slot;
+    ++freeNum_;
+  }
+
+  void addChunk(size_t nodesNum)
+  {
+    if (arena_ == nullptr)
+      arena_ = std::make_shared<Arena>(alloc_);
+
+    size_t linesNum = (nodesNum * sizeof(Slot) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+
+    auto &chunks = arena_->chunks_;
+    chunks.reserve(chunks.size() + 1);
+    CacheLine *lines = LineTraits::allocate(alloc_, linesNum);
+    chunks.push_back(Chunk{lines, linesNum});
+
+    // Rest of the previous chunk is not lost, it is already counted as free.
+    for (; bumpCur_ != bumpEnd_; ++bumpCur_)
+    {
+      putSlot(bumpCur_);
+      --freeNum_;
+    }
+
+    bumpCur_ = reinterpret_cast<Slot *>(lines);
+    bumpEnd_ = bumpCur_ + linesNum * CACHE_LINE_SIZE / sizeof(Slot);
+
+    size_t slotsNum = static_cast<size_t>(bumpEnd_ - bumpCur_);
+    capacity_ += slotsNum;
+    freeNum_ += slotsNum;
+  }
+};
+
+} // namespace tree
+
+#endif // #ifndef NODE_POOL_HH_INCL
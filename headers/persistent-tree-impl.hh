@@ -0,0 +1,241 @@
+
+#include "persistent-tree.hh"
+
+#ifndef PERSISTENT_TREE_IMPL_HH_INCL
+#define PERSISTENT_TREE_IMPL_HH_INCL
+
+namespace tree
+{
+
+template <class Data, class Compare, class Allocator>
+void PersistentStatTree<Data, Compare, Allocator>::release(const Node *node) noexcept
+{
+  if (node == nullptr || node->refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  release(node->left_);
+  release(node->right_);
+
+  Node *freed = const_cast<Node *>(node);
+  NodeTraits::destroy(alloc_, freed);
+  NodeTraits::deallocate(alloc_, freed, 1);
+}
+
+template <class Data, class Compare, class Allocator>
+typename PersistentStatTree<Data, Compare, Allocator>::Ref PersistentStatTree<Data, Compare, Allocator>::makeNode(
+  const Data &data, Ref left, Ref right)
+{
+  Node *node = NodeTraits::allocate(alloc_, 1);
+  try
+  {
+    NodeTraits::construct(alloc_, node, std::in_place, data);
+  }
+  catch (...)
+  {
+    NodeTraits::deallocate(alloc_, node, 1);
+    throw;
+  }
+
+  node->left_ = left.take();
+  node->right_ = right.take();
+  node->size_ = Node::getSize(node->left_) + Node::getSize(node->right_) + 1;
+  return Ref{this, node};
+}
+
+template <class Data, class Compare, class Allocator>
+typename PersistentStatTree<Data, Compare, Allocator>::Ref PersistentStatTree<Data, Compare, Allocator>::balance(
+  const Data &data, Ref left, Ref right)
+{
+  size_t leftSize = Node::getSize(left.get());
+  size_t rightSize = Node::getSize(right.get());
+
+  // Old sub trees are kept by left and right until the new nodes are made.
+  if (leftSize + rightSize >= 2 && rightSize > DELTA * leftSize)
+  {
+    const Node *heavy = right.get();
+    const Node *inner = heavy->left_;
+    if (Node::getSize(inner) < RATIO * Node::getSize(heavy->right_))
+      return makeNode(heavy->data_, makeNode(data, std::move(left), share(inner)), share(heavy->right_));
+
+    return makeNode(inner->data_, makeNode(data, std::move(left), share(inner->left_)),
+                    makeNode(heavy->data_, share(inner->right_), share(heavy->right_)));
+  }
+
+  if (leftSize + rightSize >= 2 && leftSize > DELTA * rightSize)
+  {
+    const Node *heavy = left.get();
+    const Node *inner = heavy->right_;
+    if (Node::getSize(inner) < RATIO * Node::getSize(heavy->left_))
+      return makeNode(heavy->data_, share(heavy->left_), makeNode(data, share(inner), std::move(right)));
+
+    return makeNode(inner->data_, makeNode(heavy->data_, share(heavy->left_), share(inner->left_)),
+                    makeNode(data, share(inner->right_), std::move(right)));
+  }
+
+  return makeNode(data, std::move(left), std::move(right));
+}
+
+template <class Data, class Compare, class Allocator>
+typename PersistentStatTree<Data, Compare, Allocator>::Ref PersistentStatTree<Data, Compare, Allocator>::insertRec(
+  const Node *node, const Data &data)
+{
+  if (node == nullptr)
+    return makeNode(data, Ref{}, Ref{});
+
+  if (comp_(data, node->data_))
+    return balance(node->data_, insertRec(node->left_, data), share(node->right_));
+  return balance(node->data_, share(node->left_), insertRec(node->right_, data));
+}
+
+template <class Data, class Compare, class Allocator>
+template <class Key>
+typename PersistentStatTree<Data, Compare, Allocator>::Ref PersistentStatTree<Data, Compare, Allocator>::eraseRec(
+  const Node *node, const Key &key)
+{
+  if (comp_(key, node->data_))
+    return balance(node->data_, eraseRec(node->left_, key), share(node->right_));
+  if (comp_(node->data_, key))
+    return balance(node->data_, share(node->left_), eraseRec(node->right_, key));
+
+  if (node->left_ == nullptr)
+    return share(node->right_);
+  if (node->right_ == nullptr)
+    return share(node->left_);
+
+  // Node is replaced with its neighbour from the bigger sub tree.
+  if (node->left_->size_ > node->right_->size_)
+  {
+    const Node *prev = node->left_;
+    while (prev->right_ != nullptr)
+      prev = prev->right_;
+    return balance(prev->data_, eraseMax(node->left_), share(node->right_));
+  }
+
+  const Node *next = node->right_;
+  while (next->left_ != nullptr)
+    next = next->left_;
+  return balance(next->data_, share(node->left_), eraseMin(node->right_));
+}
+
+template <class Data, class Compare, class Allocator>
+typename PersistentStatTree<Data, Compare, Allocator>::Ref PersistentStatTree<Data, Compare, Allocator>::eraseMin(
+  const Node *node)
+{
+  if (node->left_ == nullptr)
+    return share(node->right_);
+  return balance(node->data_, eraseMin(node->left_), share(node->right_));
+}
+
+template <class Data, class Compare, class Allocator>
+typename PersistentStatTree<Data, Compare, Allocator>::Ref PersistentStatTree<Data, Compare, Allocator>::eraseMax(
+  const Node *node)
+{
+  if (node->right_ == nullptr)
+    return share(node->left_);
+  return balance(node->data_, share(node->left_), eraseMax(node->right_));
+}
+
+template <class Data, class Compare, class Allocator>
+bool PersistentStatTree<Data, Compare, Allocator>::insert(const Data &data)
+{
+  if (find(data) != end())
+    return false;
+
+  Ref newRoot = insertRec(root_, data);
+  release(std::exchange(root_, newRoot.take()));
+  return true;
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+size_t PersistentStatTree<Data, Compare, Allocator>::erase(const Key &key)
+{
+  if (find(key) == end())
+    return 0;
+
+  Ref newRoot = eraseRec(root_, key);
+  release(std::exchange(root_, newRoot.take()));
+  return 1;
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+typename PersistentStatTree<Data, Compare, Allocator>::Iterator PersistentStatTree<Data, Compare, Allocator>::find(
+  const Key &key) const
+{
+  Iterator it = lower_bound(key);
+  if (it != end() && comp_(key, *it))
+    return end();
+  return it;
+}
+
+template <class Data, class Compare, class Allocator>
+template <LookupKey<Data, Compare> Key>
+typename PersistentStatTree<Data, Compare, Allocator>::Iterator PersistentStatTree<
+  Data, Compare, Allocator>::lower_bound(const Key &key) const
+{
+  // Nodes where the descent turns left are the next ones in order.
+  Iterator it{};
+  for (const Node *cur = root_; cur != nullptr;)
+  {
+    if (comp_(cur->data_, key))
+      cur = cur->right_;
+    else
+    {
+      it.path_.push_back(cur);
+      cur = cur->left_;
+    }
+  }
+
+  return it;
+}
+
+template <class Data, class Compare, class Allocator>
+typename PersistentStatTree<Data, Compare, Allocator>::Iterator PersistentStatTree<Data, Compare, Allocator>::select(
+  size_t k) const
+{
+  Iterator it{};
+  if (k >= size())
+    return it;
+
+  const Node *cur = root_;
+  for (size_t leftSize = Node::getSize(cur->left_); k != leftSize; leftSize = Node::getSize(cur->left_))
+  {
+    if (k < leftSize)
+    {
+      it.path_.push_back(cur);
+      cur = cur->left_;
+    }
+    else
+    {
+      k -= leftSize + 1;
+      cur = cur->right_;
+    }
+  }
+
+  it.path_.push_back(cur);
+  return it;
+}
+
+template <class Data, class Compare, class Allocator>
+template <class Key>
+size_t PersistentStatTree<Data, Compare, Allocator>::countBefore(const Key &key, bool inclusive) const
+{
+  size_t count = 0;
+  for (const Node *cur = root_; cur != nullptr;)
+  {
+    if (inclusive ? !comp_(key, cur->data_) : comp_(cur->data_, key))
+    {
+      count += Node::getSize(cur->left_) + 1;
+      cur = cur->right_;
+    }
+    else
+      cur = cur->left_;
+  }
+
+  return count;
+}
+
+} // namespace tree
+
+#endif // #ifndef PERSISTENT_TREE_IMPL_HH_INCL
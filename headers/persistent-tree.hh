@@ -0,0 +1,423 @@
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "tree.hh"
+
+#ifndef PERSISTENT_TREE_HH_INCL
+#define PERSISTENT_TREE_HH_INCL
+
+namespace tree
+{
+
+// Order statistic tree with O(1) snapshots. Nodes are immutable, refcounted and
+// shared between versions: insert and erase copy only the O(log n) nodes of the
+// path they touch (and the rotated ones), nodes are freed when the last version
+// referring to them is gone. Snapshot keeps its version alive and may be read
+// from other threads while the tree is modified. Insert and erase leave the tree
+// untouched if copying throws.
+// Nodes have no parent pointers for sharing, so the tree is weight balanced
+// (sizes needed for rank and select are the balance info as well) instead of
+// RB colored. Height stays below 2.5 log2 (n).
+template <class Data, class Compare = std::less<Data>, class Allocator = std::allocator<Data>>
+class PersistentStatTree
+{
+  friend struct TreeTester;
+
+  // Balance parameters: sibling sub tree is at most DELTA times bigger,
+  // double rotation is chosen by RATIO (Adams' tree with Hirai-Yamamoto constants).
+  static constexpr size_t DELTA = 3;
+  static constexpr size_t RATIO = 2;
+
+  struct Node
+  {
+    Data data_;
+
+    const Node *left_ = nullptr;
+    const Node *right_ = nullptr;
+    size_t size_ = 1;
+    // Number of parents and tree handles referring to the node.
+    mutable std::atomic<size_t> refs_ = 1;
+
+    template <class... Args>
+    explicit Node(std::in_place_t, Args &&...args) : data_(std::forward<Args>(args)...)
+    {}
+
+    static size_t getSize(const Node *node) noexcept
+    {
+      return node == nullptr ? 0 : node->size_;
+    }
+  };
+
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+  const Node *root_ = nullptr;
+
+  [[no_unique_address]] Compare comp_{};
+  [[no_unique_address]] NodeAllocator alloc_{};
+
+public:
+  // Forward in-order iterator. Keeps the path of nodes which are not passed yet.
+  // Iterators of the tree are invalidated by its modifications, snapshot ones
+  // live as long as the snapshot.
+  class Iterator
+  {
+    friend PersistentStatTree;
+
+    std::vector<const Node *> path_{};
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Data;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Data *;
+    using reference = const Data &;
+
+    Iterator() = default;
+
+    const Data &operator*() const noexcept
+    {
+      return path_.back()->data_;
+    }
+
+    const Data *operator->() const noexcept
+    {
+      return &path_.back()->data_;
+    }
+
+    Iterator &operator++()
+    {
+      const Node *node = path_.back()->right_;
+      path_.pop_back();
+      pushLeftmost(node);
+      return *this;
+    }
+
+    Iterator operator++(int)
+    {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const Iterator &sd) const noexcept
+    {
+      if (path_.empty() || sd.path_.empty())
+        return path_.empty() == sd.path_.empty();
+      return path_.back() == sd.path_.back();
+    }
+
+  private:
+    void pushLeftmost(const Node *node)
+    {
+      for (; node != nullptr; node = node->left_)
+        path_.push_back(node);
+    }
+  };
+
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+
+  // Immutable handle of the tree version.
+  class Snapshot;
+
+  PersistentStatTree() = default;
+
+  explicit PersistentStatTree(const Compare &comp, const Allocator &alloc = Allocator{})
+    : comp_{comp}, alloc_{alloc}
+  {}
+
+  // Copies share all nodes, so they take O(1).
+  PersistentStatTree(const PersistentStatTree &sd) : root_{retain(sd.root_)}, comp_{sd.comp_}, alloc_{sd.alloc_}
+  {}
+
+  PersistentStatTree(PersistentStatTree &&sd) noexcept : comp_{sd.comp_}, alloc_{sd.alloc_}
+  {
+    std::swap(root_, sd.root_);
+  }
+
+  PersistentStatTree &operator=(const PersistentStatTree &sd)
+  {
+    if (this != &sd)
+    {
+      PersistentStatTree copy{sd};
+      swap(copy);
+    }
+    return *this;
+  }
+
+  PersistentStatTree &operator=(PersistentStatTree &&sd) noexcept
+  {
+    if (this != &sd)
+    {
+      PersistentStatTree moved{std::move(sd)};
+      swap(moved);
+    }
+    return *this;
+  }
+
+  ~PersistentStatTree()
+  {
+    release(root_);
+  }
+
+  void swap(PersistentStatTree &sd) noexcept
+  {
+    using std::swap;
+    swap(root_, sd.root_);
+    swap(comp_, sd.comp_);
+    swap(alloc_, sd.alloc_);
+  }
+
+  // Current version of the tree in O(1).
+  Snapshot snapshot() const
+  {
+    return Snapshot{*this};
+  }
+
+  Iterator begin() const
+  {
+    Iterator it{};
+    it.pushLeftmost(root_);
+    return it;
+  }
+
+  Iterator end() const noexcept
+  {
+    return Iterator{};
+  }
+
+  size_t size() const noexcept
+  {
+    return Node::getSize(root_);
+  }
+
+  bool empty() const noexcept
+  {
+    return root_ == nullptr;
+  }
+
+  Iterator find(const Data &key) const
+  {
+    return find<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator find(const Key &key) const;
+
+  // First element not less than key.
+  Iterator lower_bound(const Data &key) const
+  {
+    return lower_bound<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator lower_bound(const Key &key) const;
+
+  // Number of elements less than key.
+  size_t rank(const Data &key) const
+  {
+    return rank<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t rank(const Key &key) const
+  {
+    return countBefore(key, false);
+  }
+
+  // Element with k elements before it (k is zero based), end() if k >= size().
+  Iterator select(size_t k) const;
+
+  // Number of elements in [lo, hi].
+  size_t countInRange(const Data &lo, const Data &hi) const
+  {
+    return countInRange<Data, Data>(lo, hi);
+  }
+  template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+  size_t countInRange(const KeyLo &lo, const KeyHi &hi) const
+  {
+    size_t notGreater = countBefore(hi, true);
+    size_t less = countBefore(lo, false);
+    return notGreater > less ? notGreater - less : 0;
+  }
+
+  // Inserts data if there is no equal element. Returns 'true' if the insertion took place.
+  bool insert(const Data &data);
+
+  // Returns the number of erased elements.
+  size_t erase(const Data &key)
+  {
+    return erase<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t erase(const Key &key);
+
+  // Drops this version, nodes shared with snapshots stay alive.
+  void clear() noexcept
+  {
+    release(std::exchange(root_, nullptr));
+  }
+
+private:
+  static const Node *retain(const Node *node) noexcept
+  {
+    if (node != nullptr)
+      node->refs_.fetch_add(1, std::memory_order_relaxed);
+    return node;
+  }
+
+  // Drops one reference and frees the nodes which are not referred anymore.
+  void release(const Node *node) noexcept;
+
+  // Owned reference to node, released unless taken.
+  class Ref
+  {
+    PersistentStatTree *tree_ = nullptr;
+    const Node *node_ = nullptr;
+
+  public:
+    Ref() = default;
+
+    Ref(PersistentStatTree *tree, const Node *node) noexcept : tree_{tree}, node_{node}
+    {}
+
+    Ref(Ref &&sd) noexcept : tree_{sd.tree_}, node_{std::exchange(sd.node_, nullptr)}
+    {}
+
+    Ref &operator=(Ref &&) = delete;
+
+    ~Ref()
+    {
+      if (node_ != nullptr)
+        tree_->release(node_);
+    }
+
+    const Node *get() const noexcept
+    {
+      return node_;
+    }
+
+    const Node *take() noexcept
+    {
+      return std::exchange(node_, nullptr);
+    }
+  };
+
+  // New reference to the node of some version.
+  Ref share(const Node *node) noexcept
+  {
+    return Ref{this, retain(node)};
+  }
+
+  // Node with a copy of data and given sub trees.
+  Ref makeNode(const Data &data, Ref left, Ref right);
+
+  // Node with data and sub trees, one of which has changed by one element since
+  // they were balanced. Makes a single or double rotation if needed.
+  Ref balance(const Data &data, Ref left, Ref right);
+
+  // Recursive parts of insert and erase: build the new version of the sub tree,
+  // the old one stays untouched. Key has to be absent (present) in the sub tree.
+  Ref insertRec(const Node *node, const Data &data);
+  template <class Key>
+  Ref eraseRec(const Node *node, const Key &key);
+  // Sub tree without its leftmost (rightmost) node.
+  Ref eraseMin(const Node *node);
+  Ref eraseMax(const Node *node);
+
+  template <class Key>
+  size_t countBefore(const Key &key, bool inclusive) const;
+};
+
+template <class Data, class Compare, class Allocator>
+class PersistentStatTree<Data, Compare, Allocator>::Snapshot
+{
+  friend PersistentStatTree;
+
+  PersistentStatTree tree_;
+
+  explicit Snapshot(const PersistentStatTree &tree) : tree_{tree}
+  {}
+
+public:
+  Iterator begin() const
+  {
+    return tree_.begin();
+  }
+
+  Iterator end() const noexcept
+  {
+    return tree_.end();
+  }
+
+  size_t size() const noexcept
+  {
+    return tree_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return tree_.empty();
+  }
+
+  Iterator find(const Data &key) const
+  {
+    return tree_.find(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator find(const Key &key) const
+  {
+    return tree_.find(key);
+  }
+
+  Iterator lower_bound(const Data &key) const
+  {
+    return tree_.lower_bound(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator lower_bound(const Key &key) const
+  {
+    return tree_.lower_bound(key);
+  }
+
+  size_t rank(const Data &key) const
+  {
+    return tree_.rank(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t rank(const Key &key) const
+  {
+    return tree_.rank(key);
+  }
+
+  Iterator select(size_t k) const
+  {
+    return tree_.select(k);
+  }
+
+  size_t countInRange(const Data &lo, const Data &hi) const
+  {
+    return tree_.countInRange(lo, hi);
+  }
+  template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+  size_t countInRange(const KeyLo &lo, const KeyHi &hi) const
+  {
+    return tree_.countInRange(lo, hi);
+  }
+
+  // Tree starting from this version.
+  PersistentStatTree toTree() const
+  {
+    return tree_;
+  }
+};
+
+} // namespace tree
+
+#include "persistent-tree-impl.hh"
+
+#endif // #ifndef PERSISTENT_TREE_HH_INCL
@@ -0,0 +1,48 @@
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+#ifndef TREE_DUMP_HH_INCL
+#define TREE_DUMP_HH_INCL
+
+namespace tree
+{
+
+// Formats of StatTree::dump. Nodes are written in pre-order, each record refers
+// to its parent record, so any prefix of the output is a valid tree top.
+enum class DumpFormat
+{
+  // Graphviz graph: left edges are solid, right ones are dotted, nils are small
+  // black nodes.
+  DOT,
+  // {"nodes":[...]} with records {"id","parent","right","key","red","size"},
+  // cut sub trees are records {"id","parent","right","cut"} with their sizes.
+  JSON,
+  // DUMP_MAGIC, uint32_t sizeof (Data), then records: uint64_t parent record
+  // (DUMP_NO_PARENT for the root), uint64_t sub tree size, uint8_t DUMP_*_FLAG
+  // set and key bytes (zeros for cut sub trees). Native byte order, keys have to
+  // be trivially copyable.
+  BINARY
+};
+
+inline constexpr std::string_view DUMP_MAGIC{"TREEDUMP", 8};
+inline constexpr uint64_t DUMP_NO_PARENT = std::numeric_limits<uint64_t>::max();
+
+inline constexpr uint8_t DUMP_RED_FLAG = 1;
+inline constexpr uint8_t DUMP_RIGHT_FLAG = 2;
+inline constexpr uint8_t DUMP_CUT_FLAG = 4;
+
+struct DumpOptions
+{
+  DumpFormat format_ = DumpFormat::DOT;
+  // Nodes deeper than maxDepth_ (root is 0) and all nodes after maxNodes_ written
+  // ones are not passed, their sub trees are written as cut records.
+  size_t maxDepth_ = std::numeric_limits<size_t>::max();
+  size_t maxNodes_ = std::numeric_limits<size_t>::max();
+};
+
+} // namespace tree
+
+#endif // #ifndef TREE_DUMP_HH_INCL
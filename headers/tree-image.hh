@@ -0,0 +1,129 @@
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+#ifndef TREE_IMAGE_HH_INCL
+#define TREE_IMAGE_HH_INCL
+
+namespace tree::image
+{
+
+// Header of FrozenStatTree image file, written in native byte order (version of
+// other byte order does not match). Sections of tree arrays follow it.
+inline constexpr std::string_view MAGIC{"STATTREE", 8};
+inline constexpr uint32_t VERSION = 1;
+
+struct Header
+{
+  char magic_[8]{};
+  uint32_t version_ = VERSION;
+  // sizeof of keys, catches images of other key types.
+  uint32_t keySize_ = 0;
+  uint64_t size_ = 0;
+  // Checksum of all sections.
+  uint64_t checksum_ = 0;
+};
+
+// 64 bit checksum of data taken by 8 byte words, continues from seed. Detects
+// corrupted and truncated files, it is not a cryptographic hash.
+inline constexpr uint64_t CHECKSUM_SEED = 0x9E3779B97F4A7C15;
+
+inline uint64_t checksum(std::string_view data, uint64_t seed = CHECKSUM_SEED) noexcept
+{
+  constexpr uint64_t MUL = 0xFF51AFD7ED558CCD;
+
+  auto mix = [](uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * MUL;
+    return hash ^ (hash >> 32);
+  };
+  // Little endian value of size <= 8 bytes.
+  auto getLE = [](const char *in, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = size; i > 0; --i)
+      value = (value << 8) | static_cast<unsigned char>(in[i - 1]);
+    return value;
+  };
+
+  uint64_t hash = seed ^ data.size();
+  size_t pos = 0;
+  for (; pos + sizeof(uint64_t) <= data.size(); pos += sizeof(uint64_t))
+  {
+    uint64_t word = 0;
+    if constexpr (std::endian::native == std::endian::little)
+      std::memcpy(&word, data.data() + pos, sizeof(word));
+    else
+      word = getLE(data.data() + pos, sizeof(uint64_t));
+    hash = mix(hash, word);
+  }
+  if (pos != data.size())
+    hash = mix(hash, getLE(data.data() + pos, data.size() - pos));
+  return mix(hash, 0);
+}
+
+// Read only mapping of a whole image file, searches access it at random.
+class MappedFile
+{
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+
+public:
+  explicit MappedFile(const std::string &path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::system_error{errno, std::generic_category(), "can't open " + path};
+
+    struct stat fileStat
+    {};
+    if (::fstat(fd, &fileStat) != 0)
+    {
+      int err = errno;
+      ::close(fd);
+      throw std::system_error{err, std::generic_category(), "can't stat " + path};
+    }
+
+    size_ = static_cast<size_t>(fileStat.st_size);
+    if (size_ != 0)
+    {
+      void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED)
+      {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error{err, std::generic_category(), "can't map " + path};
+      }
+
+      ::madvise(mapped, size_, MADV_RANDOM);
+      data_ = static_cast<const char *>(mapped);
+    }
+
+    ::close(fd);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile()
+  {
+    if (data_ != nullptr)
+      ::munmap(const_cast<char *>(data_), size_);
+  }
+
+  std::string_view view() const noexcept
+  {
+    return {data_, size_};
+  }
+};
+
+} // namespace tree::image
+
+#endif // #ifndef TREE_IMAGE_HH_INCL
@@ -7,40 +7,94 @@
 namespace tree
 {
 
-template <class Data, class Compare>
-typename StatTree<Data, Compare>::Iterator StatTree<Data, Compare>::find(const Data &toFind) const
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Node *StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::lowerBoundNode(const Key &key) const
 {
   Node *curNode = root_;
+  Node *bound = nullptr;
+  size_t depth = 0;
 
-  while (curNode != nullptr)
+  for (; curNode != nullptr; ++depth)
   {
-    const Data &curData = curNode->data_;
-
-    if (toFind > curData)
+    if (less(curNode->data_, key))
       curNode = curNode->right_;
-    else if (toFind < curData)
+    else
+    {
+      bound = curNode;
+      curNode = curNode->left_;
+    }
+  }
+
+  stats_.countDescent(depth);
+  return bound;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Node *StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::upperBoundNode(const Key &key) const
+{
+  Node *curNode = root_;
+  Node *bound = nullptr;
+  size_t depth = 0;
+
+  for (; curNode != nullptr; ++depth)
+  {
+    if (less(key, curNode->data_))
+    {
+      bound = curNode;
       curNode = curNode->left_;
+    }
     else
-      break;
+      curNode = curNode->right_;
   }
 
-  if (curNode == nullptr)
+  stats_.countDescent(depth);
+  return bound;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <LookupKey<Data, Compare> Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::find(const Key &key) const
+{
+  // Bound is not less than key, so it is equal if key is not less than it.
+  Node *bound = lowerBoundNode(key);
+  if (bound == nullptr || less(key, bound->data_))
     return end();
 
-  return Iterator{curNode, false};
+  return Iterator{bound, this};
 }
 
-template <class Data, class Compare>
-void StatTree<Data, Compare>::transplant(Node *old, Node *replacing)
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <LookupKey<Data, Compare> Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::lower_bound(const Key &key) const
+{
+  return Iterator{lowerBoundNode(key), this};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <LookupKey<Data, Compare> Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::upper_bound(const Key &key) const
+{
+  return Iterator{upperBoundNode(key), this};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::transplant(Node *old, Node *replacing)
 {
   if (old->parent_ == nullptr)
-    root_ = replacing;
+    store(root_, replacing);
   else if (old->parent_->left_ == old)
-    old->parent_->left_ = replacing;
+    store(old->parent_->left_, replacing);
   else
-    old->parent_->right_ = replacing;
+    store(old->parent_->right_, replacing);
   if (replacing != nullptr)
-    replacing->parent_ = old->parent_;
+    store(replacing->parent_, old->parent_);
 }
 
 // Rotate a node x to the right
@@ -49,29 +103,36 @@ void StatTree<Data, Compare>::transplant(Node *old, Node *replacing)
 //      y   c    --->    a   x
 //     / |                  / |
 //    a   b                b   c
-template <class Data, class Compare>
-void StatTree<Data, Compare>::rRotation(Node *node)
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::rRotation(Node *node)
 {
+  stats_.countRotation();
   Node *left_node = node->left_;
   assert(left_node != nullptr);
 
   Node *parent = node->parent_;
-  left_node->parent_ = parent;
+  store(left_node->parent_, parent);
 
   if (left_node->right_ != nullptr)
-    left_node->right_->parent_ = node;
+    store(left_node->right_->parent_, node);
 
   if (parent == nullptr)
-    root_ = left_node;
+    store(root_, left_node);
   else if (node == parent->left_)
-    parent->left_ = left_node;
+    store(parent->left_, left_node);
   else
-    parent->right_ = left_node;
+    store(parent->right_, left_node);
+
+  store(node->left_, left_node->right_);
+
+  store(left_node->right_, node);
+  store(node->parent_, left_node);
 
-  node->left_ = left_node->right_;
+  store(node->leftSize_, left_node->rightSize_);
+  store(left_node->rightSize_, Node::getSize(node));
 
-  left_node->right_ = node;
-  node->parent_ = left_node;
+  Node::pullAggregate(node);
+  Node::pullAggregate(left_node);
 }
 
 // Rotate a node x to the left
@@ -80,37 +141,62 @@ void StatTree<Data, Compare>::rRotation(Node *node)
 //      a   y    --->    x   c
 //         / |          / |
 //        b   c        a   b
-template <class Data, class Compare>
-void StatTree<Data, Compare>::lRotation(Node *node)
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::lRotation(Node *node)
 {
+  stats_.countRotation();
   Node *right_node = node->right_;
   assert(right_node != nullptr);
 
-  node->right_ = right_node->left_;
+  store(node->right_, right_node->left_);
 
   if (right_node->left_ != nullptr)
-    right_node->left_->parent_ = node;
+    store(right_node->left_->parent_, node);
 
-  right_node->parent_ = node->parent_;
+  store(right_node->parent_, node->parent_);
   if (node->parent_ == nullptr)
-    root_ = right_node;
+    store(root_, right_node);
   else if (node == node->parent_->left_)
-    node->parent_->left_ = right_node;
+    store(node->parent_->left_, right_node);
   else
-    node->parent_->right_ = right_node;
+    store(node->parent_->right_, right_node);
 
-  right_node->left_ = node;
-  node->parent_ = right_node;
+  store(right_node->left_, node);
+  store(node->parent_, right_node);
+
+  store(node->rightSize_, right_node->leftSize_);
+  store(right_node->leftSize_, Node::getSize(node));
+
+  Node::pullAggregate(node);
+  Node::pullAggregate(right_node);
 }
 
-template <class Data, class Compare>
-void StatTree<Data, Compare>::erase(Iterator delIt)
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::erase(Iterator delIt)
 {
   if (delIt == end())
     return;
 
   Node *del = delIt.ptr_;
 
+  if (del == leftmost_)
+    store(leftmost_, Node::getNext(del));
+  if (del == rightmost_)
+    store(rightmost_, Node::getPrev(del));
+
+  // Node that will be physically removed from its place: del itself or its next.
+  Node *removed = del;
+  if (del->left_ != nullptr && del->right_ != nullptr)
+  {
+    removed = del->right_;
+    while (removed->left_ != nullptr)
+      removed = removed->left_;
+  }
+
+  // Sub trees sizes on the path to the removed place.
+  updatePathSizes(removed, false);
+  store(size_, size_ - 1);
+
   // Stuff for eraseFixup.
   auto toCheck = Node::getColor(del);
   Node *toFix = nullptr;
@@ -131,9 +217,7 @@ void StatTree<Data, Compare>::erase(Iterator delIt)
   else
   {
     // Next node after del.
-    Node *next = del->right_;
-    while (next->left_ != nullptr)
-      next = next->left_;
+    Node *next = removed;
     toCheck = Node::getColor(next);
 
     toFixParent = next;
@@ -143,25 +227,190 @@ void StatTree<Data, Compare>::erase(Iterator delIt)
     {
       toFixParent = next->parent_;
       transplant(next, next->right_);
-      next->right_ = del->right_;
-      next->right_->parent_ = next;
+      store(next->right_, del->right_);
+      store(next->right_->parent_, next);
     }
 
     transplant(del, next);
-    next->left_ = del->left_;
+    store(next->left_, del->left_);
     if (next->left_ != nullptr)
-      next->left_->parent_ = next;
+      store(next->left_->parent_, next);
     next->color_ = del->color_;
+    store(next->leftSize_, del->leftSize_);
+    store(next->rightSize_, del->rightSize_);
   }
 
+  // Aggregates changed from the removed place up to the root.
+  updatePathAggregates(toFixParent);
+
   if (toCheck == Color::BLACK)
     eraseFixup(toFix, toFixParent);
 
-  delete del;
+  destroyNode(del);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+std::pair<typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator, bool> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::replace(Iterator pos, Data data)
+{
+  Node *node = pos.ptr_;
+  Node *prev = Node::getPrev(node);
+  Node *next = Node::getNext(node);
+  if ((prev == nullptr || less(prev->data_, data)) && (next == nullptr || less(data, next->data_)))
+  {
+    node->data_ = std::move(data);
+    updatePathAggregates(node);
+    return {pos, true};
+  }
+
+  erase(pos);
+  return insertUnique(std::move(data));
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <std::ranges::input_range Range>
+size_t StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::insertBatch(Range &&batch)
+{
+  std::vector<Data> sorted(std::ranges::begin(batch), std::ranges::end(batch));
+  std::sort(std::begin(sorted), std::end(sorted), comp_);
+  // Sorted, so a is not greater than b and they are equal if a is not less.
+  auto last = std::unique(std::begin(sorted), std::end(sorted), [this](const Data &a, const Data &b) {
+    return !less(a, b);
+  });
+  sorted.erase(last, std::end(sorted));
+
+  size_t oldSize = size_;
+  if (isLargeBatch(sorted.size()))
+  {
+    mergeRebuild(sorted);
+    return size_ - oldSize;
+  }
+
+  Node *finger = nullptr;
+  for (auto &data : sorted)
+  {
+    InsertPos pos = finger == nullptr ? findInsertPos(data) : findInsertPosNear(data, finger);
+    if (pos.equal_ != nullptr)
+    {
+      finger = pos.equal_;
+      continue;
+    }
+
+    Node *node = createNode(std::move(data));
+    insertNode(node, pos);
+    finger = node;
+  }
+
+  return size_ - oldSize;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <std::ranges::input_range Range>
+  requires LookupKey<std::ranges::range_value_t<Range>, Data, Compare> ||
+           std::convertible_to<std::ranges::range_value_t<Range>, Data>
+size_t StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::eraseBatch(Range &&keys)
+{
+  using Value = std::ranges::range_value_t<Range>;
+  using Key = std::conditional_t<LookupKey<Value, Data, Compare>, Value, Data>;
+
+  std::vector<Key> sorted(std::ranges::begin(keys), std::ranges::end(keys));
+  std::sort(std::begin(sorted), std::end(sorted), comp_);
+
+  size_t oldSize = size_;
+  if (isLargeBatch(sorted.size()))
+  {
+    // Content without erased keys is already sorted and unique.
+    std::vector<Data> left{};
+    left.reserve(size_);
+
+    auto keyIt = std::begin(sorted);
+    for (const auto &data : *this)
+    {
+      while (keyIt != std::end(sorted) && less(*keyIt, data))
+        ++keyIt;
+      if (keyIt == std::end(sorted) || less(data, *keyIt))
+        left.push_back(data);
+    }
+
+    rebuildSorted(std::make_move_iterator(std::begin(left)), std::make_move_iterator(std::end(left)));
+    return oldSize - size_;
+  }
+
+  // Next node after the erased one stays valid, so it is the finger.
+  Node *finger = nullptr;
+  for (const auto &key : sorted)
+  {
+    Node *subRoot = finger == nullptr ? root_ : climbFor(finger, key);
+    Node *bound = nullptr;
+    for (Node *curNode = subRoot; curNode != nullptr;)
+    {
+      if (less(curNode->data_, key))
+        curNode = curNode->right_;
+      else
+      {
+        bound = curNode;
+        curNode = curNode->left_;
+      }
+    }
+
+    if (bound == nullptr || less(key, bound->data_))
+    {
+      finger = bound;
+      continue;
+    }
+
+    finger = Node::getNext(bound);
+    erase(Iterator{bound, this});
+  }
+
+  return oldSize - size_;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::mergeRebuild(const std::vector<Data> &batch)
+{
+  std::vector<Data> merged{};
+  merged.reserve(size_ + batch.size());
+
+  // Equal keys are taken from the tree.
+  auto batchIt = std::begin(batch);
+  for (const auto &data : *this)
+  {
+    for (; batchIt != std::end(batch) && less(*batchIt, data); ++batchIt)
+      merged.push_back(*batchIt);
+    if (batchIt != std::end(batch) && !less(data, *batchIt))
+      ++batchIt;
+    merged.push_back(data);
+  }
+  merged.insert(std::end(merged), batchIt, std::end(batch));
+
+  rebuildSorted(std::make_move_iterator(std::begin(merged)), std::make_move_iterator(std::end(merged)));
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class It>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::rebuildSorted(It first, It last)
+{
+  // Counters are lent to the rebuilt tree while it creates new nodes and releases the old ones.
+  StatTree rebuilt{comp_, get_allocator()};
+  std::swap(stats_, rebuilt.stats_);
+  try
+  {
+    rebuilt.assignSorted(first, last);
+  }
+  catch (...)
+  {
+    std::swap(stats_, rebuilt.stats_);
+    throw;
+  }
+
+  swap(rebuilt);
+  rebuilt.clear();
+  std::swap(stats_, rebuilt.stats_);
 }
 
-template <class Data, class Compare>
-void StatTree<Data, Compare>::eraseFixup(Node *toFix, Node *toFixParent)
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::eraseFixup(Node *toFix, Node *toFixParent)
 {
   while (toFix != root_ && Node::getColor(toFix) == Color::BLACK)
   {
@@ -173,6 +422,7 @@ void StatTree<Data, Compare>::eraseFixup(Node *toFix, Node *toFixParent)
     Node *brother = Node::getChild(toFixParent, right);
     if (brother->color_ == Color::RED)
     {
+      stats_.countFixup(FixupCase::ERASE_RED_BROTHER);
       brother->color_ = Color::BLACK;
       toFixParent->color_ = Color::RED;
       rotation(toFixParent, left);
@@ -181,6 +431,7 @@ void StatTree<Data, Compare>::eraseFixup(Node *toFix, Node *toFixParent)
     }
     if (Node::getColor(brother->left_) == Color::BLACK && Node::getColor(brother->right_) == Color::BLACK)
     {
+      stats_.countFixup(FixupCase::ERASE_RECOLOR);
       brother->color_ = Color::RED;
       toFix = toFixParent;
       toFixParent = toFix->parent_;
@@ -189,6 +440,7 @@ void StatTree<Data, Compare>::eraseFixup(Node *toFix, Node *toFixParent)
     {
       if (Node::getColor(Node::getChild(brother, right)) == Color::BLACK)
       {
+        stats_.countFixup(FixupCase::ERASE_NEAR_NEPHEW);
         Node::getChild(brother, left)->color_ = Color::BLACK;
         brother->color_ = Color::RED;
         rotation(brother, right);
@@ -196,53 +448,234 @@ void StatTree<Data, Compare>::eraseFixup(Node *toFix, Node *toFixParent)
         brother = Node::getChild(toFixParent, right);
       }
 
+      stats_.countFixup(FixupCase::ERASE_FAR_NEPHEW);
       brother->color_ = toFixParent->color_;
       toFixParent->color_ = Color::BLACK;
-      brother->right_->color_ = Color::BLACK;
+      Node::getChild(brother, right)->color_ = Color::BLACK;
       rotation(toFixParent, left);
 
       toFix = root_;
     }
   }
 
-  toFix->color_ = Color::BLACK;
+  // Nil in case of the last node erasing.
+  if (toFix != nullptr)
+    toFix->color_ = Color::BLACK;
 }
 
-template <class Data, class Compare>
-typename StatTree<Data, Compare>::Node StatTree<Data, Compare>::insert(const Data &new_data)
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::InsertPos StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::findInsertPos(const Key &key, Node *subRoot) const
 {
-  Node *cur_root = nullptr;
-  Node *root = root_;
-  Node *new_node = new Node{new_data};
+  InsertPos pos{};
+  // Last node not greater than key.
+  Node *candidate = nullptr;
+  size_t depth = 0;
 
-  while (root != nullptr)
+  for (Node *curNode = subRoot; curNode != nullptr; ++depth)
   {
-    cur_root = root;
-    if (new_node->data_ < root->data_)
-      root = root->left_;
+    pos.parent_ = curNode;
+    pos.toLeft_ = less(key, curNode->data_);
+    if (pos.toLeft_)
+      curNode = curNode->left_;
     else
-      root = root->right_;
+    {
+      candidate = curNode;
+      curNode = curNode->right_;
+    }
+  }
+
+  if (candidate != nullptr && !less(candidate->data_, key))
+    pos.equal_ = candidate;
+
+  stats_.countDescent(depth);
+  return pos;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::InsertPos StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::findInsertPosNear(const Key &key, Node *finger) const
+{
+  if (less(finger->data_, key))
+  {
+    // Extreme keys have no bound to climb for, so they skip the climb to the root.
+    if (finger == rightmost_)
+    {
+      stats_.countDescent(0);
+      return {finger, false, nullptr};
+    }
+    return findInsertPos(key, climbFor(finger, key, Side::RIGHT));
+  }
+
+  if (less(key, finger->data_))
+  {
+    if (finger == leftmost_)
+    {
+      stats_.countDescent(0);
+      return {finger, true, nullptr};
+    }
+    return findInsertPos(key, climbFor(finger, key, Side::LEFT));
   }
 
-  new_node->parent_ = cur_root;
+  return {finger, true, finger};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Node *StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::climbFor(Node *node, const Key &key, Side side) const
+{
+  // Bound of the key side changes only on steps from the child of that side.
+  while (node->parent_ != nullptr)
+  {
+    Node *parent = node->parent_;
+    if (side == Side::RIGHT ? node == parent->left_ && less(key, parent->data_)
+                            : node == parent->right_ && less(parent->data_, key))
+      break;
+    node = parent;
+  }
+
+  return node;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::insertNode(Node *node, const InsertPos &pos)
+{
+  Node *parent = pos.parent_;
+  store(node->parent_, parent);
+  store(node->left_, nullptr);
+  store(node->right_, nullptr);
+  node->color_ = Color::RED;
+  store(node->leftSize_, 0);
+  store(node->rightSize_, 0);
 
-  if (cur_root == nullptr)
-    root_ = new_node;
-  else if (new_node->data_ < cur_root->data_)
-    cur_root->left_ = new_node;
+  if (parent == nullptr)
+  {
+    store(root_, node);
+    store(leftmost_, node);
+    store(rightmost_, node);
+  }
+  else if (pos.toLeft_)
+  {
+    store(parent->left_, node);
+    if (parent == leftmost_)
+      store(leftmost_, node);
+  }
   else
-    cur_root->right_ = new_node;
+  {
+    store(parent->right_, node);
+    if (parent == rightmost_)
+      store(rightmost_, node);
+  }
+
+  updatePathSizes(node, true);
+  updatePathAggregates(node);
+  store(size_, size_ + 1);
+
+  insertFixup(node);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::updatePathSizes(const Node *node, bool grow)
+{
+  for (Node *parent = node->parent_; parent != nullptr; node = parent, parent = parent->parent_)
+  {
+    size_t &size = node == parent->left_ ? parent->leftSize_ : parent->rightSize_;
+    store(size, grow ? size + 1 : size - 1);
+  }
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::updatePathAggregates(Node *node)
+{
+  if constexpr (AGGREGATED)
+    for (; node != nullptr; node = node->parent_)
+      Node::pullAggregate(node);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class DataArg>
+std::pair<typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator, bool> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::insertUnique(DataArg &&data, Node *finger)
+{
+  InsertPos pos = finger == nullptr ? findInsertPos(data) : findInsertPosNear(data, finger);
+  if (pos.equal_ != nullptr)
+    return {Iterator{pos.equal_, this}, false};
+
+  Node *node = createNode(std::forward<DataArg>(data));
+  insertNode(node, pos);
+  return {Iterator{node, this}, true};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+std::pair<typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator, bool> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::insert(const Data &data)
+{
+  return insertUnique(data);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+std::pair<typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator, bool> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::insert(Data &&data)
+{
+  return insertUnique(std::move(data));
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class... Args>
+std::pair<typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator, bool> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::emplace(Args &&...args)
+{
+  Node *node = createNode(std::forward<Args>(args)...);
 
-  new_node->left_ = nullptr;
-  new_node->right_ = nullptr;
-  new_node->color_ = Color::RED;
+  InsertPos pos = findInsertPos(node->data_);
+  if (pos.equal_ != nullptr)
+  {
+    destroyNode(node);
+    return {Iterator{pos.equal_, this}, false};
+  }
+
+  insertNode(node, pos);
+  return {Iterator{node, this}, true};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::insert(Iterator hint, const Data &data)
+{
+  return insertUnique(data, hint.ptr_ != nullptr ? hint.ptr_ : rightmost_).first;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::insert(Iterator hint, Data &&data)
+{
+  return insertUnique(std::move(data), hint.ptr_ != nullptr ? hint.ptr_ : rightmost_).first;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class... Args>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::emplace_hint(Iterator hint, Args &&...args)
+{
+  Node *node = createNode(std::forward<Args>(args)...);
 
-  insertFixup(new_node);
-  return (*new_node);
+  Node *finger = hint.ptr_ != nullptr ? hint.ptr_ : rightmost_;
+  InsertPos pos = finger == nullptr ? findInsertPos(node->data_) : findInsertPosNear(node->data_, finger);
+  if (pos.equal_ != nullptr)
+  {
+    destroyNode(node);
+    return Iterator{pos.equal_, this};
+  }
+
+  insertNode(node, pos);
+  return Iterator{node, this};
 }
 
-template <class Data, class Compare>
-void StatTree<Data, Compare>::insertFixup(Node *node)
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+bool StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::insertFixup(Node *node)
 {
   while (Node::getColor(node->parent_) == Color::RED)
   {
@@ -251,6 +684,7 @@ void StatTree<Data, Compare>::insertFixup(Node *node)
       Node *ppleft_node = node->parent_->parent_->right_;
       if (Node::getColor(ppleft_node) == Color::RED)
       {
+        stats_.countFixup(FixupCase::INSERT_RECOLOR);
         node->parent_->color_ = Color::BLACK;
         ppleft_node->color_ = Color::BLACK;
         node->parent_->parent_->color_ = Color::RED;
@@ -260,9 +694,11 @@ void StatTree<Data, Compare>::insertFixup(Node *node)
       {
         if (node == node->parent_->right_)
         {
+          stats_.countFixup(FixupCase::INSERT_TRIANGLE);
           node = node->parent_;
           lRotation(node);
         }
+        stats_.countFixup(FixupCase::INSERT_LINE);
         node->parent_->color_ = Color::BLACK;
         node->parent_->parent_->color_ = Color::RED;
         rRotation(node->parent_->parent_);
@@ -273,6 +709,7 @@ void StatTree<Data, Compare>::insertFixup(Node *node)
       Node *ppleft_node = node->parent_->parent_->left_;
       if (Node::getColor(ppleft_node) == Color::RED)
       {
+        stats_.countFixup(FixupCase::INSERT_RECOLOR);
         node->parent_->color_ = Color::BLACK;
         ppleft_node->color_ = Color::BLACK;
         node->parent_->parent_->color_ = Color::RED;
@@ -282,157 +719,1211 @@ void StatTree<Data, Compare>::insertFixup(Node *node)
       {
         if (node == node->parent_->left_)
         {
+          stats_.countFixup(FixupCase::INSERT_TRIANGLE);
           node = node->parent_;
           rRotation(node);
         }
+        stats_.countFixup(FixupCase::INSERT_LINE);
         node->parent_->color_ = Color::BLACK;
         node->parent_->parent_->color_ = Color::RED;
         lRotation(node->parent_->parent_);
       }
     }
   }
+  bool grown = root_->color_ == Color::RED;
   root_->color_ = Color::BLACK;
+  return grown;
 }
 
-template <class Data, class Compare>
-size_t StatTree<Data, Compare>::countLesser(const Node *node, const size_t m) const
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::StatTree(const StatTree &sd)
+  : comp_{sd.comp_},
+    pool_{std::allocator_traits<Allocator>::select_on_container_copy_construction(sd.get_allocator())}
 {
-  if (m <= node->Node::leftSize_)
-    return countLesser(node->left_, m);
-  else if (m > Node::leftSize_)
+  if (sd.root_ == nullptr)
+    return;
+
+  auto clone = [this, &sd](const Node *src, Node *parent) {
+    Node *node = createNode(src->data_);
+    node->parent_ = parent;
+    node->color_ = src->color_;
+    node->leftSize_ = src->leftSize_;
+    node->rightSize_ = src->rightSize_;
+    node->aggregate_ = src->aggregate_;
+
+    if (src == sd.leftmost_)
+      leftmost_ = node;
+    if (src == sd.rightmost_)
+      rightmost_ = node;
+    return node;
+  };
+
+  pool_.reserve(sd.size_);
+  try
+  {
+    // Both trees are passed together in pre-order, copy is always linked,
+    // so it can be cleared in case of exception.
+    root_ = clone(sd.root_, nullptr);
+    const Node *src = sd.root_;
+    Node *dst = root_;
+    while (src != nullptr)
+    {
+      if (src->left_ != nullptr && dst->left_ == nullptr)
+      {
+        dst->left_ = clone(src->left_, dst);
+        src = src->left_;
+        dst = dst->left_;
+      }
+      else if (src->right_ != nullptr && dst->right_ == nullptr)
+      {
+        dst->right_ = clone(src->right_, dst);
+        src = src->right_;
+        dst = dst->right_;
+      }
+      else
+      {
+        src = src->parent_;
+        dst = dst->parent_;
+      }
+    }
+  }
+  catch (...)
   {
-    m = m - (Node::leftSize_ + 1);
-    if (Node::leftSize_ + 1 == m)
-      return node->data_;
-    else if (Node::leftSize_ + 1 < m)
-      return countLesser(node->right_, m);
+    clear();
+    throw;
   }
+
+  size_ = sd.size_;
 }
 
-template <class Data, class Compare>
-template <class Callable>
-bool StatTree<Data, Compare>::DFS(const Callable &callable) const
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::clear() noexcept
 {
-  Node *curNode = root_;
-  std::vector<bool> rightChildPassed{};
-  size_t depth = 0;
-
-  while (curNode != nullptr)
-  {
-    if (!callable(curNode))
-      return false;
-
-    if (depth == rightChildPassed.size())
-      rightChildPassed.push_back(false);
+  destroySubtree(root_);
 
-    if (curNode->left_ != nullptr)
-    {
-      rightChildPassed[depth++] = false;
-      curNode = curNode->left_;
-      continue;
-    }
+  store(root_, nullptr);
+  store(leftmost_, nullptr);
+  store(rightmost_, nullptr);
+  store(size_, 0);
+}
 
-    if (curNode->right_ != nullptr)
-    {
-      rightChildPassed[depth++] = true;
-      curNode = curNode->right_;
-      continue;
-    }
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::destroySubtree(Node *node) noexcept
+{
+  if (node == nullptr)
+    return;
 
-    for (curNode = curNode->parent_, --depth; curNode != nullptr; --depth)
+  // Leaves are destroyed one by one, so no stack is needed.
+  Node *top = node->parent_;
+  while (node != top)
+  {
+    if (node->left_ != nullptr)
+      node = node->left_;
+    else if (node->right_ != nullptr)
+      node = node->right_;
+    else
     {
-      if (!rightChildPassed[depth] && curNode->right_ != nullptr)
+      Node *parent = node->parent_;
+      if (parent != nullptr)
       {
-        rightChildPassed[depth++] = true;
-        curNode = curNode->right_;
-        break;
+        if (parent->left_ == node)
+          store(parent->left_, nullptr);
+        else
+          store(parent->right_, nullptr);
       }
 
-      curNode = curNode->parent_;
+      destroyNode(node);
+      node = parent;
     }
   }
-
-  return true;
 }
 
-template <class Data, class Compare>
-bool StatTree<Data, Compare>::dump() const
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <std::input_iterator It>
+  requires std::sized_sentinel_for<It, It>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::assignSorted(It first, It last, size_t threadsNum)
 {
-  return DFS<tree::StatTree<Data, Compare>::Dumper>(Dumper{*this});
+  clear();
+
+  size_t size = static_cast<size_t>(last - first);
+  if (size == 0)
+    return;
+
+  // Pool is not thread safe, so nodes are created in advance.
+  std::vector<Node *> nodes{};
+  nodes.reserve(size);
+  pool_.reserve(size);
+  try
+  {
+    for (; first != last; ++first)
+      nodes.push_back(createNode(*first));
+  }
+  catch (...)
+  {
+    for (Node *node : nodes)
+      destroyNode(node);
+    throw;
+  }
+
+  // All levels except the last one are full, last one is red.
+  size_t redDepth = std::bit_width(size) - 1;
+
+  root_ = linkSorted(nodes.data(), 0, size, 0, redDepth, std::max<size_t>(threadsNum, 1));
+  root_->parent_ = nullptr;
+  root_->color_ = Color::BLACK;
+  size_ = size;
+
+  leftmost_ = nodes.front();
+  rightmost_ = nodes.back();
 }
 
-template <class Data, class Compare>
-bool StatTree<Data, Compare>::Dumper::operator()(const Node *node) const noexcept
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Node *StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::linkSorted(Node *const *nodes, size_t lo, size_t hi, size_t depth,
+                                                          size_t redDepth, size_t threadsNum) noexcept
 {
-  std::ofstream out("tree.txt", std::ios::app);
-  if (out.is_open())
+  // Smaller sub trees are not worth a thread.
+  constexpr size_t MIN_THREAD_SIZE = 1 << 14;
+
+  if (lo == hi)
+    return nullptr;
+
+  size_t mid = lo + (hi - lo) / 2;
+  Node *node = nodes[mid];
+
+  Node *left = nullptr;
+  Node *right = nullptr;
+  if (threadsNum > 1 && hi - lo >= MIN_THREAD_SIZE)
   {
-    if (node == nullptr)
+    size_t leftThreads = threadsNum / 2;
+    std::thread leftBuilder{};
+    try
     {
-      return true;
+      leftBuilder = std::thread{[&] { left = linkSorted(nodes, lo, mid, depth + 1, redDepth, leftThreads); }};
+    }
+    catch (const std::system_error &)
+    {
+      left = linkSorted(nodes, lo, mid, depth + 1, redDepth, leftThreads);
     }
 
-    if (node->left_ != nullptr)
-      out << "\"" << node->data_ << "\" -> "
-          << " \"" << node->left_->data_ << "\""
-          << ";" << std::endl;
-    else
+    right = linkSorted(nodes, mid + 1, hi, depth + 1, redDepth, threadsNum - leftThreads);
+    if (leftBuilder.joinable())
+      leftBuilder.join();
+  }
+  else
+  {
+    left = linkSorted(nodes, lo, mid, depth + 1, redDepth, 1);
+    right = linkSorted(nodes, mid + 1, hi, depth + 1, redDepth, 1);
+  }
+
+  node->left_ = left;
+  node->right_ = right;
+  if (left != nullptr)
+    left->parent_ = node;
+  if (right != nullptr)
+    right->parent_ = node;
+
+  node->leftSize_ = mid - lo;
+  node->rightSize_ = hi - mid - 1;
+  node->color_ = depth == redDepth ? Color::RED : Color::BLACK;
+  Node::pullAggregate(node);
+
+  return node;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+size_t StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::countBefore(const Key &key, bool inclusive) const
+{
+  size_t count = 0;
+  Node *curNode = root_;
+  size_t depth = 0;
+
+  for (; curNode != nullptr; ++depth)
+  {
+    bool before = inclusive ? !less(key, curNode->data_) : less(curNode->data_, key);
+    if (before)
     {
-      ++cout_nils;
-      out << "\"" << node->data_ << "\" -> "
-          << " \""
-          << "nil" << cout_nils << "\""
-          << ";" << std::endl;
-      out << "\""
-          << "nil" << cout_nils << "\""
-          << "[style=\"filled\",fontcolor=\"white\",fillcolor="
-          << "\""
-          << "BLACK"
-          << "\"];" << std::endl;
-    }
-
-    if (node->right_ != nullptr)
-      out << "\"" << node->data_ << "\" -> "
-          << " \"" << node->right_->data_ << "\""
-          << "[style="
-          << "\""
-          << "dotted"
-          << "\""
-          << "];" << std::endl;
+      count += curNode->leftSize_ + 1;
+      curNode = curNode->right_;
+    }
     else
-    {
-      ++cout_nils;
-      out << "\"" << node->data_ << "\" -> "
-          << " \""
-          << "nil" << cout_nils << "\""
-          << "[style="
-          << "\""
-          << "dotted"
-          << "\""
-          << "];" << std::endl;
-      out << "\""
-          << "nil" << cout_nils << "\""
-          << "[style=\"filled\",fontcolor=\"white\",fillcolor="
-          << "\""
-          << "BLACK"
-          << "\"];" << std::endl;
-    }
-
-    if (node != nullptr && node->color_ == Color::RED)
-      out << "\"" << node->data_ << "\""
-          << "[style=\"filled\",fontcolor=\"white\",fillcolor="
-          << "\""
-          << "RED"
-          << "\"];" << std::endl;
-    else if (node == nullptr || node->color_ == Color::BLACK)
-      out << "\"" << node->data_ << "\""
-          << "[style=\"filled\",fontcolor=\"white\",fillcolor="
-          << "\""
-          << "BLACK"
-          << "\"];" << std::endl;
+      curNode = curNode->left_;
   }
-  out.close();
-  return true;
+
+  stats_.countDescent(depth);
+  return count;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <LookupKey<Data, Compare> Key>
+size_t StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::rank(const Key &key) const
+{
+  return countBefore(key, false);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::select(size_t k) const
+{
+  if (k >= size_)
+    return end();
+
+  Node *curNode = root_;
+  size_t depth = 1;
+  for (; k != curNode->leftSize_; ++depth)
+  {
+    if (k < curNode->leftSize_)
+      curNode = curNode->left_;
+    else
+    {
+      k -= curNode->leftSize_ + 1;
+      curNode = curNode->right_;
+    }
+  }
+
+  stats_.countDescent(depth);
+  return Iterator{curNode, this};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+size_t StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::countInRange(const KeyLo &lo, const KeyHi &hi) const
+{
+  // Keys are not compared with each other, so hi < lo gives notGreater <= less.
+  size_t notGreater = countBefore(hi, true);
+  size_t less = countBefore(lo, false);
+  return notGreater > less ? notGreater - less : 0;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::AggregateValue StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::aggregateFrom(const Node *node, const Key &key) const
+{
+  // Nodes are met in decreasing order, so the found parts are prepended.
+  AggregateValue result = Aggregate::identity();
+  while (node != nullptr)
+  {
+    if (less(node->data_, key))
+      node = node->right_;
+    else
+    {
+      AggregateValue part = Aggregate::combine(Aggregate::lift(node->data_), Node::getAggregate(node->right_));
+      result = Aggregate::combine(part, result);
+      node = node->left_;
+    }
+  }
+
+  return result;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::AggregateValue StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::aggregateTo(const Node *node, const Key &key,
+                                                                  bool inclusive) const
+{
+  // Nodes are met in increasing order, so the found parts are appended.
+  AggregateValue result = Aggregate::identity();
+  while (node != nullptr)
+  {
+    if (inclusive ? !less(key, node->data_) : less(node->data_, key))
+    {
+      AggregateValue part = Aggregate::combine(Node::getAggregate(node->left_), Aggregate::lift(node->data_));
+      result = Aggregate::combine(result, part);
+      node = node->right_;
+    }
+    else
+      node = node->left_;
+  }
+
+  return result;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::AggregateValue StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::aggregate(const KeyLo &lo, const KeyHi &hi) const
+{
+  // Descent to the first node inside [lo, hi], it splits the range in two paths.
+  // Keys are not compared with each other, so hi < lo gives nil.
+  Node *curNode = root_;
+  while (curNode != nullptr)
+  {
+    if (less(curNode->data_, lo))
+      curNode = curNode->right_;
+    else if (less(hi, curNode->data_))
+      curNode = curNode->left_;
+    else
+      break;
+  }
+
+  if (curNode == nullptr)
+    return Aggregate::identity();
+
+  AggregateValue left = Aggregate::combine(aggregateFrom(curNode->left_, lo), Aggregate::lift(curNode->data_));
+  return Aggregate::combine(left, aggregateTo(curNode->right_, hi, true));
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Pred>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Iterator StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::findPrefix(Pred pred, AggregateValue *before) const
+{
+  // Aggregate of all elements before the current sub tree.
+  AggregateValue passed = Aggregate::identity();
+  Node *curNode = root_;
+
+  while (curNode != nullptr)
+  {
+    AggregateValue withLeft = Aggregate::combine(passed, Node::getAggregate(curNode->left_));
+    if (curNode->left_ != nullptr && pred(withLeft))
+    {
+      curNode = curNode->left_;
+      continue;
+    }
+
+    AggregateValue withNode = Aggregate::combine(withLeft, Aggregate::lift(curNode->data_));
+    if (pred(withNode))
+    {
+      if (before != nullptr)
+        *before = withLeft;
+      return Iterator{curNode, this};
+    }
+
+    passed = withNode;
+    curNode = curNode->right_;
+  }
+
+  return end();
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+Data StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::lesserOfOrderK(size_t k) const
+{
+  if (k == 0 || k > size_)
+    throw std::out_of_range{"lesserOfOrderK: k is out of range"};
+  return *select(k - 1);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+TreeStats StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::stats() const
+  requires Stats::ENABLED
+{
+  TreeStats stats = stats_.snapshot();
+  stats.size_ = size_;
+
+  // Root depth is 1 here, so empty tree has 0 height.
+  auto heightVisitor = [&stats](const Node *, size_t depth) { stats.height_ = std::max(stats.height_, depth); };
+  visitNodes<TraversalOrder::PRE>(root_, 1, heightVisitor);
+  return stats;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <TraversalOrder Order, class Visitor>
+bool StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::visitNodes(Node *root, size_t rootDepth,
+                                                                             Visitor &visitor)
+{
+  if (root == nullptr)
+    return true;
+
+  if constexpr (Order == TraversalOrder::PRE)
+    return visitPreOrder(root, rootDepth, visitor);
+  else if constexpr (Order == TraversalOrder::IN)
+    return visitInOrder(root, rootDepth, visitor);
+  else if constexpr (Order == TraversalOrder::POST)
+    return visitPostOrder(root, rootDepth, visitor);
+  else
+    return visitLevelOrder(root, rootDepth, visitor);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Visitor>
+bool StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::visitPreOrder(Node *root, size_t rootDepth,
+                                                                         Visitor &visitor)
+{
+  Node *curNode = root;
+  size_t depth = rootDepth;
+
+  while (true)
+  {
+    Visit visit = callVisitor(visitor, curNode, depth);
+    if (visit == Visit::STOP)
+      return false;
+
+    if (visit == Visit::CONTINUE && (curNode->left_ != nullptr || curNode->right_ != nullptr))
+    {
+      curNode = curNode->left_ != nullptr ? curNode->left_ : curNode->right_;
+      ++depth;
+      continue;
+    }
+
+    // Climbs to the lowest ancestor which right sub tree is not passed yet.
+    while (true)
+    {
+      if (curNode == root)
+        return true;
+
+      Node *parent = curNode->parent_;
+      --depth;
+      if (curNode == parent->left_ && parent->right_ != nullptr)
+      {
+        curNode = parent->right_;
+        ++depth;
+        break;
+      }
+      curNode = parent;
+    }
+  }
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Visitor>
+bool StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::visitInOrder(Node *root, size_t rootDepth,
+                                                                        Visitor &visitor)
+{
+  Node *curNode = root;
+  size_t depth = rootDepth;
+  for (; curNode->left_ != nullptr; ++depth)
+    curNode = curNode->left_;
+
+  while (true)
+  {
+    if (callVisitor(visitor, curNode, depth) == Visit::STOP)
+      return false;
+
+    if (curNode->right_ != nullptr)
+    {
+      curNode = curNode->right_;
+      for (++depth; curNode->left_ != nullptr; ++depth)
+        curNode = curNode->left_;
+      continue;
+    }
+
+    // Climbs from right children, the next node is the parent of the left one.
+    while (true)
+    {
+      if (curNode == root)
+        return true;
+
+      Node *parent = curNode->parent_;
+      --depth;
+      bool fromLeft = curNode == parent->left_;
+      curNode = parent;
+      if (fromLeft)
+        break;
+    }
+  }
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Visitor>
+bool StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::visitPostOrder(Node *root, size_t rootDepth,
+                                                                          Visitor &visitor)
+{
+  // The first node of sub tree in post-order: the leaf reached by preferring left.
+  auto firstLeaf = [](Node *node, size_t &depth) {
+    while (node->left_ != nullptr || node->right_ != nullptr)
+    {
+      node = node->left_ != nullptr ? node->left_ : node->right_;
+      ++depth;
+    }
+    return node;
+  };
+
+  size_t depth = rootDepth;
+  Node *curNode = firstLeaf(root, depth);
+
+  while (true)
+  {
+    if (callVisitor(visitor, curNode, depth) == Visit::STOP)
+      return false;
+    if (curNode == root)
+      return true;
+
+    Node *parent = curNode->parent_;
+    if (curNode == parent->left_ && parent->right_ != nullptr)
+      curNode = firstLeaf(parent->right_, depth);
+    else
+    {
+      curNode = parent;
+      --depth;
+    }
+  }
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Visitor>
+bool StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::visitLevelOrder(Node *root, size_t rootDepth,
+                                                                           Visitor &visitor)
+{
+  // Every level is a pre-order pass pruned at it, no queue is needed.
+  for (size_t level = rootDepth;; ++level)
+  {
+    bool levelFound = false;
+    bool stopped = false;
+    auto levelVisitor = [&](Node *node, size_t depth) {
+      if (depth < level)
+        return Visit::CONTINUE;
+
+      levelFound = true;
+      stopped = callVisitor(visitor, node, depth) == Visit::STOP;
+      return stopped ? Visit::STOP : Visit::SKIP_CHILDREN;
+    };
+
+    visitPreOrder(root, rootDepth, levelVisitor);
+    if (stopped)
+      return false;
+    if (!levelFound)
+      return true;
+  }
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Visitor, class Merge, class Proj>
+bool StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::visitNodesParallel(Visitor &visitor, Merge merge,
+                                                                              size_t threadsNum, Proj proj) const
+{
+  auto projected = [&proj](Visitor &target) {
+    return [&proj, &target](Node *node, size_t depth) { return callVisitor(target, proj(node), depth); };
+  };
+
+  if (threadsNum <= 1)
+  {
+    auto whole = projected(visitor);
+    return visitNodes<TraversalOrder::PRE>(root_, 0, whole);
+  }
+
+  // About 2-4 sub trees per thread, so uneven ones are balanced by taking the next one.
+  const size_t splitDepth = std::bit_width(threadsNum) + 1;
+  std::vector<Visitor> locals(threadsNum, visitor);
+
+  std::vector<Node *> subtrees{};
+  auto topVisitor = [&, top = projected(visitor)](Node *node, size_t depth) mutable {
+    if (depth < splitDepth)
+      return top(node, depth);
+
+    subtrees.push_back(node);
+    return Visit::SKIP_CHILDREN;
+  };
+  if (!visitNodes<TraversalOrder::PRE>(root_, 0, topVisitor))
+    return false;
+
+  std::atomic<bool> stopped = false;
+  std::atomic<size_t> nextSubtree = 0;
+  auto work = [&](Visitor &local) {
+    auto guarded = [&, call = projected(local)](Node *node, size_t depth) mutable {
+      if (stopped.load(std::memory_order_relaxed))
+        return Visit::STOP;
+
+      Visit visit = call(node, depth);
+      if (visit == Visit::STOP)
+        stopped.store(true, std::memory_order_relaxed);
+      return visit;
+    };
+
+    for (size_t idx = nextSubtree++; idx < subtrees.size(); idx = nextSubtree++)
+      if (!visitNodes<TraversalOrder::PRE>(subtrees[idx], splitDepth, guarded))
+        return;
+  };
+
+  // Sub trees are taken one by one, so any number of started threads passes all of them.
+  std::vector<std::thread> workers{};
+  workers.reserve(threadsNum - 1);
+  try
+  {
+    for (size_t i = 0; i + 1 < threadsNum; ++i)
+      workers.emplace_back(work, std::ref(locals[i]));
+  }
+  catch (const std::system_error &)
+  {}
+
+  work(locals.back());
+  for (auto &worker : workers)
+    worker.join();
+
+  for (auto &local : locals)
+    merge(visitor, std::move(local));
+  return !stopped;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::dump(std::ostream &out,
+                                                                       const DumpOptions &options) const
+{
+  Dumper{out, options}.dump(root_);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::dump(const std::string &path,
+                                                                const DumpOptions &options) const
+{
+  // Buffer is set before opening and outlives the stream.
+  std::vector<char> buffer(DUMP_BUFFER_SIZE);
+  std::ofstream out{};
+  out.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  out.open(path, std::ios::binary);
+  if (!out.is_open())
+    throw std::runtime_error{"can't open " + path};
+
+  dump(out, options);
+  out.close();
+  if (!out)
+    throw std::runtime_error{"can't write " + path};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <LookupKey<Data, Compare> Key>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::dumpAround(std::ostream &out, const Key &key,
+                                                                      size_t levelsUp, const DumpOptions &options) const
+{
+  std::vector<Node *> path{};
+  for (Node *curNode = root_; curNode != nullptr;)
+  {
+    path.push_back(curNode);
+    if (less(key, curNode->data_))
+      curNode = curNode->left_;
+    else if (less(curNode->data_, key))
+      curNode = curNode->right_;
+    else
+      break;
+  }
+
+  Node *root = path.empty() ? nullptr : path[path.size() - 1 - std::min(levelsUp, path.size() - 1)];
+  Dumper{out, options}.dump(root);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+bool StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::dump() const
+{
+  try
+  {
+    dump(std::string{"tree.txt"});
+  }
+  catch (const std::runtime_error &)
+  {
+    return false;
+  }
+  return true;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Dumper::dump(Node *root)
+{
+  switch (options_.format_)
+  {
+  case DumpFormat::DOT:
+    out_ << "digraph DG {\n";
+    break;
+  case DumpFormat::JSON:
+    out_ << "{\"nodes\":[";
+    break;
+  case DumpFormat::BINARY:
+    if constexpr (std::is_trivially_copyable_v<Data>)
+    {
+      uint32_t keySize = sizeof(Data);
+      out_.write(DUMP_MAGIC.data(), static_cast<std::streamsize>(DUMP_MAGIC.size()));
+      out_.write(reinterpret_cast<const char *>(&keySize), sizeof(keySize));
+      break;
+    }
+    else
+      throw std::invalid_argument{"binary dump needs trivially copyable keys"};
+  }
+
+  visitNodes<TraversalOrder::PRE>(root, 0, *this);
+
+  if (options_.format_ == DumpFormat::DOT)
+    out_ << "}\n";
+  else if (options_.format_ == DumpFormat::JSON)
+    out_ << "]}\n";
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+Visit StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Dumper::operator()(const Node *node, size_t depth)
+{
+  Entry entry{node, depth == 0 ? DUMP_NO_PARENT : pathIds_[depth - 1], depth,
+              depth != 0 && node == node->parent_->right_};
+
+  // Nodes after the limits are roots of not passed sub trees.
+  if (depth > options_.maxDepth_ || nodesNum_ == options_.maxNodes_)
+  {
+    writeCut(entry);
+    return Visit::SKIP_CHILDREN;
+  }
+
+  uint64_t id = writeNode(entry);
+  pathIds_[depth] = id;
+  ++nodesNum_;
+
+  if (options_.format_ == DumpFormat::DOT)
+    for (bool isRight : {true, false})
+      if ((isRight ? node->right_ : node->left_) == nullptr)
+        writeNil(id, isRight);
+
+  return Visit::CONTINUE;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+uint64_t StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Dumper::writeNode(const Entry &entry)
+{
+  const Node *node = entry.node_;
+  bool isRed = node->color_ == Color::RED;
+  uint64_t id = recordsNum_++;
+
+  uint8_t flags = (isRed ? DUMP_RED_FLAG : 0) | (entry.isRight_ ? DUMP_RIGHT_FLAG : 0);
+  beginRecord(entry, id, Node::getSize(node), flags);
+
+  switch (options_.format_)
+  {
+  case DumpFormat::DOT:
+    out_ << "n" << id << "[label=";
+    writeKey(node->data_);
+    out_ << ",style=\"filled\",fontcolor=\"white\",fillcolor=\"" << (isRed ? "RED" : "BLACK") << "\"];\n";
+    writeEdge(entry.parent_, "n", id, entry.isRight_);
+    break;
+  case DumpFormat::JSON:
+    out_ << ",\"key\":";
+    writeKey(node->data_);
+    out_ << ",\"red\":" << (isRed ? "true" : "false") << ",\"size\":" << Node::getSize(node) << "}";
+    break;
+  case DumpFormat::BINARY:
+    if constexpr (std::is_trivially_copyable_v<Data>)
+      out_.write(reinterpret_cast<const char *>(&node->data_), sizeof(Data));
+    break;
+  }
+
+  return id;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+uint64_t StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Dumper::writeCut(const Entry &entry)
+{
+  uint64_t id = recordsNum_++;
+  size_t size = Node::getSize(entry.node_);
+  beginRecord(entry, id, size, DUMP_CUT_FLAG | (entry.isRight_ ? DUMP_RIGHT_FLAG : 0));
+
+  switch (options_.format_)
+  {
+  case DumpFormat::DOT:
+    out_ << "n" << id << "[shape=\"box\",label=\"" << size << " more\"];\n";
+    writeEdge(entry.parent_, "n", id, entry.isRight_);
+    break;
+  case DumpFormat::JSON:
+    out_ << ",\"cut\":" << size << "}";
+    break;
+  case DumpFormat::BINARY: {
+    const char zeros[sizeof(Data)]{};
+    out_.write(zeros, sizeof(zeros));
+    break;
+  }
+  }
+
+  return id;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Dumper::writeNil(uint64_t parent, bool isRight)
+{
+  size_t id = ++nilsNum_;
+  out_ << "nil" << id << "[style=\"filled\",fontcolor=\"white\",fillcolor=\"BLACK\"];\n";
+  writeEdge(parent, "nil", id, isRight);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Dumper::beginRecord(const Entry &entry, uint64_t id,
+                                                                               uint64_t size, uint8_t flags)
+{
+  if (options_.format_ == DumpFormat::JSON)
+  {
+    out_ << (id == 0 ? "\n{" : ",\n{") << "\"id\":" << id << ",\"parent\":";
+    if (entry.parent_ == DUMP_NO_PARENT)
+      out_ << "null";
+    else
+      out_ << entry.parent_;
+    out_ << ",\"right\":" << (entry.isRight_ ? "true" : "false");
+  }
+  else if (options_.format_ == DumpFormat::BINARY)
+  {
+    out_.write(reinterpret_cast<const char *>(&entry.parent_), sizeof(entry.parent_));
+    out_.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    out_.put(static_cast<char>(flags));
+  }
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Dumper::writeEdge(uint64_t parent,
+                                                                             std::string_view child, uint64_t id,
+                                                                             bool isRight)
+{
+  if (parent == DUMP_NO_PARENT)
+    return;
+
+  out_ << "n" << parent << " -> " << child << id << (isRight ? "[style=\"dotted\"];\n" : ";\n");
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Dumper::writeKey(const Data &data)
+{
+  if constexpr (std::is_arithmetic_v<Data>)
+  {
+    // DOT labels are strings.
+    if (options_.format_ == DumpFormat::DOT)
+      out_ << "\"" << data << "\"";
+    else
+      out_ << data;
+  }
+  else
+  {
+    std::ostringstream text{};
+    text << data;
+
+    out_ << "\"";
+    for (char c : text.view())
+    {
+      if (c == '"' || c == '\\')
+        out_ << '\\';
+      out_ << c;
+    }
+    out_ << "\"";
+  }
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <LookupKey<Data, Compare> Key>
+std::pair<StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>,
+          StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>>
+StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::split(const Key &key)
+{
+  StatTree right{comp_, get_allocator()};
+  pool_.share(right.pool_);
+
+  auto [leftPart, equal, rightPart] = splitParts(releasePart(), key);
+  if (equal != nullptr)
+    rightPart = joinParts(Part{}, equal, rightPart);
+
+  assignPart(leftPart);
+  right.assignPart(rightPart);
+  return {std::move(*this), std::move(right)};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+StatTree<Data, Compare, Allocator, Aggregate, Stats, Links> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::join(StatTree &&left, Data pivot, StatTree &&right)
+{
+  assert(left.empty() || left.comp_(*left.rbegin(), pivot));
+  assert(right.empty() || left.comp_(pivot, *right.begin()));
+
+  StatTree joined{std::move(left)};
+  joined.pool_.adopt(right.pool_);
+  Node *node = joined.createNode(std::move(pivot));
+
+  Part leftPart = joined.releasePart();
+  joined.assignPart(joined.joinParts(leftPart, node, right.releasePart()));
+  return joined;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+StatTree<Data, Compare, Allocator, Aggregate, Stats, Links> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::join(StatTree &&left, StatTree &&right)
+{
+  assert(left.empty() || right.empty() || left.comp_(*left.rbegin(), *right.begin()));
+
+  StatTree joined{std::move(left)};
+  joined.pool_.adopt(right.pool_);
+
+  Part leftPart = joined.releasePart();
+  joined.assignPart(joined.joinParts(leftPart, right.releasePart()));
+  return joined;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+StatTree<Data, Compare, Allocator, Aggregate, Stats, Links> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::setUnion(StatTree &&lhs, StatTree &&rhs)
+{
+  StatTree united{std::move(lhs)};
+  united.pool_.adopt(rhs.pool_);
+
+  Part lhsPart = united.releasePart();
+  united.assignPart(united.uniteParts(lhsPart, rhs.releasePart()));
+  return united;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+StatTree<Data, Compare, Allocator, Aggregate, Stats, Links> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::setIntersection(StatTree &&lhs, StatTree &&rhs)
+{
+  StatTree intersected{std::move(lhs)};
+  intersected.pool_.adopt(rhs.pool_);
+
+  Part lhsPart = intersected.releasePart();
+  intersected.assignPart(intersected.intersectParts(lhsPart, rhs.releasePart()));
+  return intersected;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+StatTree<Data, Compare, Allocator, Aggregate, Stats, Links> StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::setDifference(StatTree &&lhs, StatTree &&rhs)
+{
+  StatTree subtracted{std::move(lhs)};
+  subtracted.pool_.adopt(rhs.pool_);
+
+  Part lhsPart = subtracted.releasePart();
+  subtracted.assignPart(subtracted.subtractParts(lhsPart, rhs.releasePart()));
+  return subtracted;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+size_t StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::getBlackHeight(const Node *node)
+{
+  size_t blackHeight = 0;
+  for (; node != nullptr; node = node->left_)
+    if (node->color_ == Color::BLACK)
+      ++blackHeight;
+  return blackHeight;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Part StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::detach(Node *node, size_t blackHeight)
+{
+  if (node == nullptr)
+    return Part{};
+
+  node->parent_ = nullptr;
+  return Part{node, blackHeight};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Part StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::releasePart()
+{
+  Part part{root_, getBlackHeight(root_)};
+
+  root_ = leftmost_ = rightmost_ = nullptr;
+  size_ = 0;
+  return part;
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+void StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::assignPart(Part part)
+{
+  root_ = part.root_;
+  size_ = Node::getSize(root_);
+  if (root_ == nullptr)
+  {
+    leftmost_ = rightmost_ = nullptr;
+    return;
+  }
+
+  root_->parent_ = nullptr;
+  root_->color_ = Color::BLACK;
+  leftmost_ = Node::getLeftmost(root_);
+  rightmost_ = Node::getRightmost(root_);
+}
+
+// Pivot takes place of the first black node with the lower part black height on the
+// inner spine of the higher part, so that black heights are equal. Then it is a
+// usual red node insertion.
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Part StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::joinParts(Part left, Node *pivot, Part right)
+{
+  // Detached roots can be red, making them black keeps invariants.
+  for (Part *part : {&left, &right})
+    if (Node::getColor(part->root_) == Color::RED)
+    {
+      part->root_->color_ = Color::BLACK;
+      ++part->blackHeight_;
+    }
+
+  pivot->left_ = pivot->right_ = pivot->parent_ = nullptr;
+  pivot->color_ = Color::RED;
+
+  bool leftHigher = left.blackHeight_ >= right.blackHeight_;
+  Part &higher = leftHigher ? left : right;
+  Part &lower = leftHigher ? right : left;
+  auto inner = leftHigher ? Side::RIGHT : Side::LEFT;
+
+  if (higher.root_ == nullptr)
+  {
+    pivot->color_ = Color::BLACK;
+    pivot->leftSize_ = pivot->rightSize_ = 0;
+    Node::pullAggregate(pivot);
+    return Part{pivot, 1};
+  }
+
+  Node *parent = nullptr;
+  Node *cur = higher.root_;
+  for (size_t blackHeight = higher.blackHeight_;
+       cur != nullptr && !(cur->color_ == Color::BLACK && blackHeight == lower.blackHeight_);
+       cur = Node::getChild(cur, inner))
+  {
+    if (cur->color_ == Color::BLACK)
+      --blackHeight;
+    parent = cur;
+  }
+
+  root_ = higher.root_;
+  pivot->parent_ = parent;
+  if (parent == nullptr)
+    root_ = pivot;
+  else if (inner == Side::RIGHT)
+    parent->right_ = pivot;
+  else
+    parent->left_ = pivot;
+
+  if (cur != nullptr)
+    cur->parent_ = pivot;
+  if (lower.root_ != nullptr)
+    lower.root_->parent_ = pivot;
+
+  size_t lowerSize = Node::getSize(lower.root_);
+  if (leftHigher)
+  {
+    pivot->left_ = cur;
+    pivot->right_ = lower.root_;
+    pivot->leftSize_ = Node::getSize(cur);
+    pivot->rightSize_ = lowerSize;
+  }
+  else
+  {
+    pivot->left_ = lower.root_;
+    pivot->right_ = cur;
+    pivot->leftSize_ = lowerSize;
+    pivot->rightSize_ = Node::getSize(cur);
+  }
+
+  for (Node *ancestor = parent; ancestor != nullptr; ancestor = ancestor->parent_)
+    if (leftHigher)
+      ancestor->rightSize_ += lowerSize + 1;
+    else
+      ancestor->leftSize_ += lowerSize + 1;
+  updatePathAggregates(pivot);
+
+  bool grown = insertFixup(pivot);
+  return Part{root_, higher.blackHeight_ + (grown ? 1 : 0)};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Part StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::joinParts(Part left, Part right)
+{
+  if (right.root_ == nullptr)
+    return left;
+  if (left.root_ == nullptr)
+    return right;
+
+  // The first node of right becomes pivot.
+  auto [none, first, rest] = splitParts(right, Node::getLeftmost(right.root_)->data_);
+  return joinParts(left, first, rest);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+template <class Key>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::SplitParts StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::splitParts(Part part, const Key &key)
+{
+  Node *node = part.root_;
+  if (node == nullptr)
+    return SplitParts{};
+
+  size_t childHeight = part.blackHeight_ - (node->color_ == Color::BLACK ? 1 : 0);
+  Part left = detach(node->left_, childHeight);
+  Part right = detach(node->right_, childHeight);
+
+  if (less(node->data_, key))
+  {
+    SplitParts parts = splitParts(right, key);
+    parts.left_ = joinParts(left, node, parts.left_);
+    return parts;
+  }
+  if (less(key, node->data_))
+  {
+    SplitParts parts = splitParts(left, key);
+    parts.right_ = joinParts(parts.right_, node, right);
+    return parts;
+  }
+
+  return SplitParts{left, node, right};
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Part StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::uniteParts(Part lhs, Part rhs)
+{
+  if (lhs.root_ == nullptr)
+    return rhs;
+  if (rhs.root_ == nullptr)
+    return lhs;
+
+  Node *node = lhs.root_;
+  size_t childHeight = lhs.blackHeight_ - (node->color_ == Color::BLACK ? 1 : 0);
+  Part lhsLeft = detach(node->left_, childHeight);
+  Part lhsRight = detach(node->right_, childHeight);
+
+  auto [rhsLeft, equal, rhsRight] = splitParts(rhs, node->data_);
+  if (equal != nullptr)
+    destroyNode(equal);
+
+  Part left = uniteParts(lhsLeft, rhsLeft);
+  Part right = uniteParts(lhsRight, rhsRight);
+  return joinParts(left, node, right);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Part StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::intersectParts(Part lhs, Part rhs)
+{
+  if (lhs.root_ == nullptr || rhs.root_ == nullptr)
+  {
+    destroySubtree(lhs.root_);
+    destroySubtree(rhs.root_);
+    return Part{};
+  }
+
+  Node *node = lhs.root_;
+  size_t childHeight = lhs.blackHeight_ - (node->color_ == Color::BLACK ? 1 : 0);
+  Part lhsLeft = detach(node->left_, childHeight);
+  Part lhsRight = detach(node->right_, childHeight);
+
+  auto [rhsLeft, equal, rhsRight] = splitParts(rhs, node->data_);
+
+  Part left = intersectParts(lhsLeft, rhsLeft);
+  Part right = intersectParts(lhsRight, rhsRight);
+  if (equal != nullptr)
+  {
+    destroyNode(equal);
+    return joinParts(left, node, right);
+  }
+
+  destroyNode(node);
+  return joinParts(left, right);
+}
+
+template <class Data, class Compare, class Allocator, class Aggregate, class Stats, class Links>
+typename StatTree<Data, Compare, Allocator, Aggregate, Stats, Links>::Part StatTree<
+  Data, Compare, Allocator, Aggregate, Stats, Links>::subtractParts(Part lhs, Part rhs)
+{
+  if (lhs.root_ == nullptr || rhs.root_ == nullptr)
+  {
+    destroySubtree(rhs.root_);
+    return lhs;
+  }
+
+  Node *node = rhs.root_;
+  size_t childHeight = rhs.blackHeight_ - (node->color_ == Color::BLACK ? 1 : 0);
+  Part rhsLeft = detach(node->left_, childHeight);
+  Part rhsRight = detach(node->right_, childHeight);
+
+  auto [lhsLeft, equal, lhsRight] = splitParts(lhs, node->data_);
+  destroyNode(node);
+  if (equal != nullptr)
+    destroyNode(equal);
+
+  Part left = subtractParts(lhsLeft, rhsLeft);
+  Part right = subtractParts(lhsRight, rhsRight);
+  return joinParts(left, right);
 }
 
 } // namespace tree
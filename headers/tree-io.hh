@@ -0,0 +1,102 @@
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#ifndef TREE_IO_HH_INCL
+#define TREE_IO_HH_INCL
+
+namespace tree::io
+{
+
+// Whole input available as one read only buffer: memory mapped file or
+// stdin read at once.
+class InputData
+{
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool isMapped_ = false;
+  std::string buffer_{};
+
+  InputData() = default;
+
+public:
+  static InputData mapFile(const std::string &path);
+  static InputData readStdin();
+
+  InputData(InputData &&sd) noexcept;
+  InputData &operator=(InputData &&) = delete;
+  InputData(const InputData &) = delete;
+  InputData &operator=(const InputData &) = delete;
+
+  ~InputData();
+
+  std::string_view view() const noexcept
+  {
+    return {data_, size_};
+  }
+};
+
+enum class OpCode : uint8_t
+{
+  INSERT,
+  ERASE,
+  FIND,
+  RANK,
+  SELECT
+};
+
+struct Op
+{
+  OpCode code_ = OpCode::INSERT;
+  int key_ = 0;
+};
+
+// Binary op log: BINARY_MAGIC, uint64_t ops number, then packed records of
+// 1 byte op code and 4 bytes key, all little endian.
+inline constexpr std::string_view BINARY_MAGIC{"TREEOPS\1", 8};
+inline constexpr size_t BINARY_RECORD_SIZE = 5;
+
+// Reads ops from the input one by one without copying it. Binary op log is
+// detected by its magic, other input is the text format of the task:
+// inserts number, keys to insert, erases number, keys to erase.
+// Throws std::runtime_error on malformed input.
+class OpReader
+{
+  std::string_view input_;
+  size_t pos_ = 0;
+
+  bool isBinary_ = false;
+  // Ops left in the current text section or in the binary log.
+  uint64_t left_ = 0;
+  OpCode textCode_ = OpCode::INSERT;
+
+public:
+  explicit OpReader(std::string_view input);
+
+  bool isBinary() const noexcept
+  {
+    return isBinary_;
+  }
+
+  // Returns 'false' when input is over.
+  bool next(Op &op);
+
+private:
+  // Returns 'false' if only whitespaces are left.
+  bool parseInt(int64_t &num);
+};
+
+// Parses decimal integer from [cur, end) skipping leading whitespaces and
+// moves cur after it. Eight digits at once are handled with SWAR arithmetic.
+// Returns 'false' if there is no integer, or if it is out of int64_t range, then
+// cur is left at the first non whitespace character.
+bool parseInt(const char *&cur, const char *end, int64_t &num) noexcept;
+
+// Writes all ops of reader in binary op log format.
+void writeBinary(const std::string &path, OpReader &reader);
+
+} // namespace tree::io
+
+#endif // #ifndef TREE_IO_HH_INCL
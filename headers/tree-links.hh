@@ -0,0 +1,48 @@
+#include <atomic>
+#include <concepts>
+#include <type_traits>
+
+#ifndef TREE_LINKS_HH_INCL
+#define TREE_LINKS_HH_INCL
+
+namespace tree
+{
+
+// Links policy decides how StatTree stores node links and sizes and whether
+// memory of erased nodes is reused by later inserts.
+template <class Policy>
+concept LinksPolicy = requires(int *&link, int *value) {
+  { Policy::RECYCLES_NODES } -> std::convertible_to<bool>;
+  Policy::store(link, value);
+};
+
+// Default policy, plain stores and recycled nodes.
+struct PlainLinks
+{
+  static constexpr bool RECYCLES_NODES = true;
+
+  template <class T>
+  static void store(T &field, std::type_identity_t<T> value) noexcept
+  {
+    field = value;
+  }
+};
+
+// Policy of trees read without locks while they are modified (ConcurrentStatTree).
+// Stores are release ones, so a reader which loads a link with acquire sees the
+// node constructed. Erased nodes are never reused while the tree lives, so a
+// reader which still holds one reads its unchanged memory.
+struct PublishedLinks
+{
+  static constexpr bool RECYCLES_NODES = false;
+
+  template <class T>
+  static void store(T &field, std::type_identity_t<T> value) noexcept
+  {
+    std::atomic_ref<T>{field}.store(value, std::memory_order_release);
+  }
+};
+
+} // namespace tree
+
+#endif // #ifndef TREE_LINKS_HH_INCL
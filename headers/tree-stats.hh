@@ -0,0 +1,173 @@
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#ifndef TREE_STATS_HH_INCL
+#define TREE_STATS_HH_INCL
+
+namespace tree
+{
+
+// Cases of StatTree rebalancing.
+enum class FixupCase : uint8_t
+{
+  // Red uncle: recoloring, the fixup goes two levels up.
+  INSERT_RECOLOR,
+  // Node and parent are on different sides: rotation at the parent first.
+  INSERT_TRIANGLE,
+  // Final rotation at the grandparent.
+  INSERT_LINE,
+  // Red brother: rotation at the parent makes it black.
+  ERASE_RED_BROTHER,
+  // Black brother with black children: recoloring, the fixup goes one level up.
+  ERASE_RECOLOR,
+  // Red near nephew: rotation at the brother first.
+  ERASE_NEAR_NEPHEW,
+  // Final rotation at the parent.
+  ERASE_FAR_NEPHEW,
+  COUNT
+};
+
+inline constexpr size_t FIXUP_CASES_NUM = static_cast<size_t>(FixupCase::COUNT);
+
+// Snapshot of StatTree counters (see StatTree::stats).
+struct TreeStats
+{
+  // Descents deeper than DEPTHS_NUM - 1 go to the last bucket.
+  static constexpr size_t DEPTHS_NUM = 64;
+
+  uint64_t comparisons_ = 0;
+  uint64_t rotations_ = 0;
+  uint64_t fixupCases_[FIXUP_CASES_NUM]{};
+  uint64_t insertFixupIterations_ = 0;
+  uint64_t eraseFixupIterations_ = 0;
+  // descentDepths_[d] is the number of descents which passed d nodes.
+  uint64_t descentDepths_[DEPTHS_NUM]{};
+  uint64_t nodesCreated_ = 0;
+  uint64_t nodesDestroyed_ = 0;
+
+  // Filled by the snapshot.
+  size_t size_ = 0;
+  size_t height_ = 0;
+
+  uint64_t fixups(FixupCase fixupCase) const noexcept
+  {
+    return fixupCases_[static_cast<size_t>(fixupCase)];
+  }
+
+  uint64_t descents() const noexcept
+  {
+    uint64_t descents = 0;
+    for (uint64_t num : descentDepths_)
+      descents += num;
+    return descents;
+  }
+
+  friend std::ostream &operator<<(std::ostream &out, const TreeStats &stats)
+  {
+    static constexpr const char *FIXUP_NAMES[FIXUP_CASES_NUM]{"insert recolor",    "insert triangle",
+                                                               "insert line",       "erase red brother",
+                                                               "erase recolor",     "erase near nephew",
+                                                               "erase far nephew"};
+
+    out << "size " << stats.size_ << ", height " << stats.height_ << "\n"
+        << "comparisons " << stats.comparisons_ << ", rotations " << stats.rotations_ << "\n"
+        << "fixup iterations: insert " << stats.insertFixupIterations_ << ", erase " << stats.eraseFixupIterations_
+        << "\n";
+    for (size_t i = 0; i < FIXUP_CASES_NUM; ++i)
+      out << "  " << FIXUP_NAMES[i] << " " << stats.fixupCases_[i] << "\n";
+    out << "nodes created " << stats.nodesCreated_ << ", destroyed " << stats.nodesDestroyed_ << "\n"
+        << "descent depths:";
+    for (size_t depth = 0; depth < TreeStats::DEPTHS_NUM; ++depth)
+      if (stats.descentDepths_[depth] != 0)
+        out << " " << depth << ":" << stats.descentDepths_[depth];
+    return out << "\n";
+  }
+};
+
+// Stats policy decides at compile time what StatTree counts. Counters are plain
+// integers, so a counted tree must not be read from several threads at once.
+template <class Policy>
+concept StatsPolicy = requires(Policy &policy, const Policy &constPolicy, FixupCase fixupCase, size_t depth) {
+  { Policy::ENABLED } -> std::convertible_to<bool>;
+  policy.countComparison();
+  policy.countRotation();
+  policy.countFixup(fixupCase);
+  policy.countDescent(depth);
+  policy.countCreated();
+  policy.countDestroyed();
+  { constPolicy.snapshot() } -> std::same_as<TreeStats>;
+};
+
+// Default policy, counts nothing and takes no space.
+struct NoStats
+{
+  static constexpr bool ENABLED = false;
+
+  void countComparison() noexcept
+  {}
+  void countRotation() noexcept
+  {}
+  void countFixup(FixupCase) noexcept
+  {}
+  void countDescent(size_t) noexcept
+  {}
+  void countCreated() noexcept
+  {}
+  void countDestroyed() noexcept
+  {}
+
+  TreeStats snapshot() const noexcept
+  {
+    return {};
+  }
+};
+
+// Counts everything TreeStats has.
+struct CountingStats
+{
+  static constexpr bool ENABLED = true;
+
+  TreeStats stats_{};
+
+  void countComparison() noexcept
+  {
+    ++stats_.comparisons_;
+  }
+  void countRotation() noexcept
+  {
+    ++stats_.rotations_;
+  }
+  void countFixup(FixupCase fixupCase) noexcept
+  {
+    ++stats_.fixupCases_[static_cast<size_t>(fixupCase)];
+    // Every loop iteration ends with exactly one of recoloring or final rotation.
+    if (fixupCase == FixupCase::INSERT_RECOLOR || fixupCase == FixupCase::INSERT_LINE)
+      ++stats_.insertFixupIterations_;
+    else if (fixupCase == FixupCase::ERASE_RECOLOR || fixupCase == FixupCase::ERASE_FAR_NEPHEW)
+      ++stats_.eraseFixupIterations_;
+  }
+  void countDescent(size_t depth) noexcept
+  {
+    ++stats_.descentDepths_[depth < TreeStats::DEPTHS_NUM ? depth : TreeStats::DEPTHS_NUM - 1];
+  }
+  void countCreated() noexcept
+  {
+    ++stats_.nodesCreated_;
+  }
+  void countDestroyed() noexcept
+  {
+    ++stats_.nodesDestroyed_;
+  }
+
+  TreeStats snapshot() const noexcept
+  {
+    return stats_;
+  }
+};
+
+} // namespace tree
+
+#endif // #ifndef TREE_STATS_HH_INCL
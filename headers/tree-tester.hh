@@ -1,4 +1,8 @@
 
+#include "block-tree.hh"
+#include "compact-tree.hh"
+#include "multiset-tree.hh"
+#include "persistent-tree.hh"
 #include "tree.hh"
 #include <iostream>
 
@@ -14,78 +18,106 @@ struct TreeTester
   struct TestData
   {
     size_t value_ = 0;
-    bool passToggle_ = false;
 
     TestData(size_t value) : value_{value}
     {}
 
-    // Checks if that node were toggled with taken treePassToggle
-    // value last time and toggles passToggle_ to do such checks in future.
-    // Used in verify passes to avoid looping.
-    bool passToggle(bool treePassToggle) noexcept
+    std::strong_ordering operator<=>(const TestData &sd) const noexcept
     {
-      bool curToggleVal = passToggle_;
-      return curToggleVal == (passToggle_ = treePassToggle);
+      return value_ <=> sd.value_;
     }
 
-    std::strong_ordering operator<=>(const TestData &) const = default;
+    bool operator==(const TestData &sd) const noexcept
+    {
+      return value_ == sd.value_;
+    }
   };
 
   using TestTree = StatTree<TestData>;
   using TestNode = TestTree::Node;
 
-  // Runs all needed tests.
-  static bool verify(const TestTree &tree);
-
-  // Checks that StatTree have binary tree structure.
-  struct StructTester
-  {
-    const size_t treeSize_;
-    const bool passToggle_;
-    mutable size_t passedNum_ = 0;
+  using SumTestTree = StatTree<size_t, std::less<size_t>, std::allocator<size_t>, SumAggregate<size_t>>;
+  using SumTestNode = SumTestTree::Node;
 
-    StructTester(const TestTree &tree)
-      : treeSize_{tree.size()}, passToggle_{tree.root_ != nullptr && tree.root_->data_.passToggle_}
-    {}
+  using MultisetTestTree = StatMultiset<size_t>;
 
-    bool operator()(TestNode *) const noexcept;
-  };
+  using CompactTestTree = CompactStatTree<size_t>;
+  using BlockTestTree = BlockStatTree<int>;
+  using PersistentTestTree = PersistentStatTree<size_t>;
+  using PersistentTestNode = PersistentTestTree::Node;
 
-  // Checks that all sizes are counted correctly.
-  struct SizesTester
-  {
-    mutable bool rootPassed_ = false;
-    const size_t treeSize_;
+  // Trees of this size and larger are verified on all hardware threads.
+  static constexpr size_t PARALLEL_VERIFY_SIZE = size_t{1} << 16;
 
-    SizesTester(const TestTree &tree) : treeSize_{tree.size()}
-    {}
+  // Runs all needed tests.
+  static bool verify(const TestTree &tree);
+  static bool verify(const CompactTestTree &tree);
+  static bool verify(const PersistentTestTree &tree);
+  static bool verify(const SumTestTree &tree);
+  static bool verify(const BlockTestTree &tree);
+  static bool verify(const MultisetTestTree &tree);
 
-    bool operator()(const TestNode *node) const noexcept;
-  };
+  // Runs all needed tests on threadsNum threads.
+  static bool verify(const TestTree &tree, size_t threadsNum);
 
-// Checks that tree is ordered correctly.
-#if 0
-  struct SortedOrderTester
+  // Node with k nodes before it (k < tree.size ()), lets tests break invariants.
+  static TestNode *nodeAt(TestTree &tree, size_t k) noexcept
   {
-    mutable bool sorted_order = false;
+    TestNode *node = tree.root_;
+    while (k != node->leftSize_)
+      if (k < node->leftSize_)
+        node = node->left_;
+      else
+      {
+        k -= node->leftSize_ + 1;
+        node = node->right_;
+      }
+    return node;
+  }
+
+  // Checks all invariants of compact tree sub tree and counts its black height.
+  // Returns 'false' if some of invariants are broken.
+  static bool verifyCompact(const CompactTestTree &tree, uint32_t idx, uint32_t parent, size_t &blackHeight);
+
+  // Checks order, sizes and weight balance of persistent tree sub tree.
+  static bool verifyPersistent(const PersistentTestNode *node);
+
+  // Checks order, parent links, colors, black heights, sizes and aggregates of
+  // StatTree in one bottom-up pass without extra memory. Sub trees below the top
+  // levels are checked in parallel, the top is checked on their results.
+  template <class Tree>
+  struct StatVerifier
+  {
+    using Node = typename Tree::Node;
 
-    SortedOrderTester(const TestTree &tree)
+    // Result of sub tree check.
+    struct Subtree
+    {
+      const Node *min_ = nullptr;
+      const Node *max_ = nullptr;
+      size_t size_ = 0;
+      // Black nodes on every path down to nil, nil included.
+      size_t blackHeight_ = 1;
+      bool valid_ = true;
+    };
+
+    const Tree &tree_;
+    // RB tree of n nodes is not higher than 2 log (n + 1), deeper nodes mean a loop.
+    const size_t maxDepth_;
+    // Nodes at splitDepth_ take results of the sub trees checked in parallel from
+    // ready_ one by one.
+    size_t splitDepth_ = std::numeric_limits<size_t>::max();
+    const Subtree *ready_ = nullptr;
+
+    explicit StatVerifier(const Tree &tree) : tree_{tree}, maxDepth_{2 * std::bit_width(tree.size() + 1)}
     {}
 
-    bool operator()(const TestNode *node) const noexcept;
-  };
-#endif
-
-  // Checks that RB-tree invariants are met.
-  struct ColorsTester
-  {
-    TestNode *root_;
-    mutable std::unordered_map<TestNode *, size_t> blackHeights_{};
+    bool verify(size_t threadsNum);
 
-    ColorsTester(const TestTree &tree) : root_{tree.root_}
-    {}
+    Subtree check(const Node *node, size_t depth);
 
-    bool operator()(TestNode *node) const;
+    // Collects roots of sub trees at splitDepth_ from the left to the right.
+    void collect(const Node *node, size_t depth, std::vector<const Node *> &subtrees) const;
   };
 };
 
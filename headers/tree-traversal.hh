@@ -0,0 +1,47 @@
+
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+#ifndef TREE_TRAVERSAL_HH_INCL
+#define TREE_TRAVERSAL_HH_INCL
+
+namespace tree
+{
+
+enum class TraversalOrder
+{
+  PRE,
+  IN,
+  POST,
+  // Nodes of each depth from the left to the right.
+  LEVEL
+};
+
+// What a traversal does after a visitor call.
+enum class Visit
+{
+  CONTINUE,
+  // Sub tree of the node is not passed (PRE order only, other orders reach a node
+  // after its children or can't remember pruned nodes).
+  SKIP_CHILDREN,
+  STOP
+};
+
+// Visitors may return nothing, that means CONTINUE.
+template <class Visitor, class... Args>
+Visit callVisitor(Visitor &visitor, Args &&...args)
+{
+  if constexpr (std::same_as<std::invoke_result_t<Visitor &, Args...>, void>)
+  {
+    std::invoke(visitor, std::forward<Args>(args)...);
+    return Visit::CONTINUE;
+  }
+  else
+    return std::invoke(visitor, std::forward<Args>(args)...);
+}
+
+} // namespace tree
+
+#endif // #ifndef TREE_TRAVERSAL_HH_INCL
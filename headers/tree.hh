@@ -1,11 +1,34 @@
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <ranges>
 #include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+
+#include "aggregate.hh"
+#include "node-pool.hh"
+#include "tree-dump.hh"
+#include "tree-links.hh"
+#include "tree-stats.hh"
+#include "tree-traversal.hh"
 
 #ifndef TREE_HH_INCL
 #define TREE_HH_INCL
@@ -13,12 +36,38 @@
 namespace tree
 {
 
+// Lookups take any Key if Compare is transparent and only Data otherwise.
+template <class Key, class Data, class Compare>
+concept LookupKey = std::same_as<Key, Data> || requires { typename Compare::is_transparent; };
+
+template <class Data, class Compare>
+class FrozenStatTree;
+
 // RB Tree that provides stat calc methods with log (n) computational
-// complexity.
-template <class Data, class Compare = std::less<Data>>
+// complexity. Besides sizes every sub tree keeps its Aggregate (see aggregate.hh),
+// which gives range aggregates and weighted select in log (n) as well.
+// Stats policy (see tree-stats.hh) counts comparisons, rotations, fixup cases,
+// descent depths and node allocations, NoStats compiles all of it out.
+// Links policy (see tree-links.hh) makes link stores atomic for lock free readers.
+template <class Data, class Compare = std::less<Data>, class Allocator = std::allocator<Data>,
+          class Aggregate = NoAggregate, class Stats = NoStats, class Links = PlainLinks>
 class StatTree
 {
+  static_assert(AggregatePolicy<Aggregate, Data>, "Aggregate has to provide identity, lift and combine");
+  static_assert(StatsPolicy<Stats>, "Stats has to provide all count methods and snapshot");
+  static_assert(LinksPolicy<Links>, "Links has to provide store and RECYCLES_NODES");
+
   friend class TreeTester;
+  // Reads nodes without locks.
+  template <class, class, class>
+  friend class ConcurrentStatTree;
+
+public:
+  using AggregateValue = typename Aggregate::value_type;
+
+private:
+  // Aggregate of NoAggregate is not maintained at all.
+  static constexpr bool AGGREGATED = !std::same_as<Aggregate, NoAggregate>;
 
   enum class Side
   {
@@ -35,6 +84,10 @@ class StatTree
   {
     Data data_;
 
+    template <class... Args>
+    explicit Node(std::in_place_t, Args &&...args) : data_(std::forward<Args>(args)...)
+    {}
+
     Node *left_ = nullptr;
     Node *right_ = nullptr;
     Node *parent_ = nullptr;
@@ -43,6 +96,8 @@ class StatTree
     // Sub trees sizes.
     size_t leftSize_ = 0;
     size_t rightSize_ = 0;
+    // Aggregate of the sub tree with the root in node.
+    [[no_unique_address]] AggregateValue aggregate_ = Aggregate::identity();
 
     static Color getColor(const Node *node)
     {
@@ -57,48 +112,208 @@ class StatTree
         return node->left_;
       return node->right_;
     }
+
+    // Size of the sub tree with the root in node (0 for nil).
+    static size_t getSize(const Node *node)
+    {
+      if (node == nullptr)
+        return 0;
+      return node->leftSize_ + node->rightSize_ + 1;
+    }
+
+    static AggregateValue getAggregate(const Node *node)
+    {
+      if (node == nullptr)
+        return Aggregate::identity();
+      return node->aggregate_;
+    }
+
+    // Aggregate of node sub tree made of its children ones.
+    static AggregateValue combineAggregate(const Node *node)
+    {
+      AggregateValue withData = Aggregate::combine(getAggregate(node->left_), Aggregate::lift(node->data_));
+      return Aggregate::combine(withData, getAggregate(node->right_));
+    }
+
+    // Recalculates aggregate of node from its children ones.
+    static void pullAggregate(Node *node)
+    {
+      if constexpr (AGGREGATED)
+        node->aggregate_ = combineAggregate(node);
+    }
+
+    static Node *getLeftmost(Node *node)
+    {
+      while (node->left_ != nullptr)
+        node = node->left_;
+      return node;
+    }
+
+    static Node *getRightmost(Node *node)
+    {
+      while (node->right_ != nullptr)
+        node = node->right_;
+      return node;
+    }
+
+    // In-order neighbours, nullptr after the last (before the first) node.
+    static Node *getNext(Node *node)
+    {
+      if (node->right_ != nullptr)
+        return getLeftmost(node->right_);
+      while (node->parent_ != nullptr && node == node->parent_->right_)
+        node = node->parent_;
+      return node->parent_;
+    }
+
+    static Node *getPrev(Node *node)
+    {
+      if (node->left_ != nullptr)
+        return getRightmost(node->left_);
+      while (node->parent_ != nullptr && node == node->parent_->left_)
+        node = node->parent_;
+      return node->parent_;
+    }
   };
 
   Node *root_ = nullptr;
   size_t size_ = 0;
 
+  // Cached first and last nodes for O(1) begin () and --end ().
+  Node *leftmost_ = nullptr;
+  Node *rightmost_ = nullptr;
+
+  [[no_unique_address]] Compare comp_{};
+
+  NodePool<Node, Allocator> pool_;
+
+  // Counters belong to the tree object: they are not copied, moved or swapped.
+  [[no_unique_address]] mutable Stats stats_{};
+
+  // Compare call counted by Stats.
+  template <class Lhs, class Rhs>
+  bool less(const Lhs &lhs, const Rhs &rhs) const
+  {
+    stats_.countComparison();
+    return comp_(lhs, rhs);
+  }
+
+  template <class... Args>
+  Node *createNode(Args &&...args)
+  {
+    Node *node = pool_.create(std::in_place, std::forward<Args>(args)...);
+    stats_.countCreated();
+    return node;
+  }
+
+  void destroyNode(Node *node) noexcept
+  {
+    stats_.countDestroyed();
+    if constexpr (Links::RECYCLES_NODES)
+      pool_.destroy(node);
+    else
+      pool_.retire(node);
+  }
+
+  // Stores link or size as Links policy says.
+  template <class T>
+  static void store(T &field, std::type_identity_t<T> value) noexcept
+  {
+    Links::store(field, value);
+  }
+
 public:
+  // Bidirectional in-order iterator. End iterator has no node and the tree
+  // plays sentinel role for it, so it stays valid while the tree is modified.
   class Iterator
   {
     friend StatTree;
 
     Node *ptr_ = nullptr;
-    bool isEnd_ = false;
+    const StatTree *tree_ = nullptr;
 
-    Iterator(Node *ptr, bool isEnd) : ptr_{ptr}, isEnd_{isEnd}
+    Iterator(Node *ptr, const StatTree *tree) : ptr_{ptr}, tree_{tree}
     {}
 
   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Data;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Data *;
+    using reference = const Data &;
+
+    Iterator() = default;
+
     const Data &operator*() const noexcept
     {
       return ptr_->data_;
     }
 
+    const Data *operator->() const noexcept
+    {
+      return &ptr_->data_;
+    }
+
+    Iterator &operator++() noexcept
+    {
+      ptr_ = Node::getNext(ptr_);
+      return *this;
+    }
+
+    Iterator operator++(int) noexcept
+    {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    Iterator &operator--() noexcept
+    {
+      ptr_ = ptr_ == nullptr ? tree_->rightmost_ : Node::getPrev(ptr_);
+      return *this;
+    }
+
+    Iterator operator--(int) noexcept
+    {
+      Iterator old = *this;
+      --*this;
+      return old;
+    }
+
     bool operator==(const Iterator &sd) const noexcept
     {
-      if (isEnd_ == sd.isEnd_)
-      {
-        if (isEnd_)
-          return true;
-        return ptr_ == sd.ptr_;
-      }
-      return false;
+      return ptr_ == sd.ptr_;
     }
   };
 
-  Iterator end() const
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+  using reverse_iterator = std::reverse_iterator<Iterator>;
+  using const_reverse_iterator = reverse_iterator;
+
+  Iterator begin() const noexcept
   {
-    Node *end = root_;
-    if (end == nullptr)
-      return Iterator{nullptr, true};
-    while (end->right_ != nullptr)
-      end = end->right_;
-    return Iterator{end, true};
+    return Iterator{leftmost_, this};
+  }
+
+  Iterator end() const noexcept
+  {
+    return Iterator{nullptr, this};
+  }
+
+  reverse_iterator rbegin() const noexcept
+  {
+    return reverse_iterator{end()};
+  }
+
+  reverse_iterator rend() const noexcept
+  {
+    return reverse_iterator{begin()};
+  }
+
+  bool empty() const noexcept
+  {
+    return size_ == 0;
   }
 
   size_t size() const noexcept
@@ -106,20 +321,222 @@ public:
     return size_;
   }
 
+  // Preallocates memory for n nodes.
+  void reserve(size_t n)
+  {
+    if (n > size_)
+      pool_.reserve(n - size_);
+  }
+
   StatTree() = default;
 
-  // Will implement later:
-  ~StatTree() = default;
+  explicit StatTree(const Allocator &alloc) : pool_{alloc}
+  {}
+
+  explicit StatTree(const Compare &comp, const Allocator &alloc = Allocator{}) : comp_{comp}, pool_{alloc}
+  {}
+
+  // Strictly increasing random access ranges are loaded in O(n), others are
+  // inserted one by one, so equal keys are dropped as by insert.
+  template <std::input_iterator It>
+  StatTree(It first, It last, const Compare &comp = Compare{}, const Allocator &alloc = Allocator{})
+    : comp_{comp}, pool_{alloc}
+  {
+    if constexpr (std::random_access_iterator<It>)
+      if (std::adjacent_find(first, last, [this](const auto &a, const auto &b) { return !less(a, b); }) == last)
+      {
+        assignSorted(first, last);
+        return;
+      }
+
+    for (; first != last; ++first)
+      insert(*first);
+  }
+
+  ~StatTree()
+  {
+    clear();
+  }
+
+  // Copies structure and colors as is, so no rebalancing is done.
+  StatTree(const StatTree &sd);
+
+  StatTree(StatTree &&sd) noexcept : comp_{sd.comp_}, pool_{std::move(sd.pool_)}
+  {
+    std::swap(root_, sd.root_);
+    std::swap(size_, sd.size_);
+    std::swap(leftmost_, sd.leftmost_);
+    std::swap(rightmost_, sd.rightmost_);
+  }
+
+  StatTree &operator=(const StatTree &sd)
+  {
+    if (this != &sd)
+    {
+      StatTree copy{sd};
+      swap(copy);
+    }
+    return *this;
+  }
+
+  StatTree &operator=(StatTree &&sd) noexcept
+  {
+    if (this != &sd)
+    {
+      StatTree moved{std::move(sd)};
+      swap(moved);
+    }
+    return *this;
+  }
 
-  StatTree(const StatTree &) = delete;
-  StatTree operator=(const StatTree &) = delete;
-  StatTree operator=(StatTree &&sd) = delete;
-  StatTree(StatTree &&sd) = delete;
+  // Counters (see stats ()) are not swapped, they stay with their trees.
+  void swap(StatTree &sd) noexcept
+  {
+    using std::swap;
+    swap(root_, sd.root_);
+    swap(size_, sd.size_);
+    swap(leftmost_, sd.leftmost_);
+    swap(rightmost_, sd.rightmost_);
+    swap(comp_, sd.comp_);
+    pool_.swap(sd.pool_);
+  }
+
+  Allocator get_allocator() const noexcept
+  {
+    return pool_.get_allocator();
+  }
+
+  Iterator find(const Data &key) const
+  {
+    return find<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator find(const Key &key) const;
+
+  // First element not less than key.
+  Iterator lower_bound(const Data &key) const
+  {
+    return lower_bound<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator lower_bound(const Key &key) const;
+
+  // First element greater than key.
+  Iterator upper_bound(const Data &key) const
+  {
+    return upper_bound<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  Iterator upper_bound(const Key &key) const;
+
+  std::pair<Iterator, Iterator> equal_range(const Data &key) const
+  {
+    return equal_range<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  std::pair<Iterator, Iterator> equal_range(const Key &key) const
+  {
+    return {lower_bound(key), upper_bound(key)};
+  }
+
+  // Inserts data if there is no equal element. Returns iterator to the element with
+  // such key and 'true' if the insertion took place.
+  std::pair<Iterator, bool> insert(const Data &data);
+  std::pair<Iterator, bool> insert(Data &&data);
+
+  // Constructs data in place. Node is released if the key is already present.
+  template <class... Args>
+  std::pair<Iterator, bool> emplace(Args &&...args);
+
+  // Finger search versions of insert and emplace: the place is searched from hint
+  // (rightmost element for end ()) climbing only as far as needed, so a key d
+  // positions away takes O(log d) comparisons instead of O(log n). Keys greater than
+  // all elements are appended without descent. Passing the iterator returned by the
+  // previous insert (or end () for appends) makes almost sorted input cost amortized
+  // O(1) comparisons, only sizes are still updated up to the root.
+  // Returns iterator to the element with such key.
+  Iterator insert(Iterator hint, const Data &data);
+  Iterator insert(Iterator hint, Data &&data);
+  template <class... Args>
+  Iterator emplace_hint(Iterator hint, Args &&...args);
 
-  Iterator find(const Data &) const;
-  Node insert(const Data &new_data);
   void erase(Iterator delIt);
 
+  // Replaces element at pos with data. If data keeps the place of the old element
+  // in order, the node is reused without rebalancing, otherwise it is erase and
+  // insert. Returns the same as insert.
+  std::pair<Iterator, bool> replace(Iterator pos, Data data);
+
+  // Calls func (Data &) for the element at pos and recalculates aggregates. func
+  // must not change the place of the element in order.
+  template <class Func>
+  void modify(Iterator pos, Func func)
+  {
+    func(pos.ptr_->data_);
+    updatePathAggregates(pos.ptr_);
+  }
+
+  // Erases element equal to key in one descent. Returns the number of erased elements.
+  size_t erase(const Data &key)
+  {
+    return erase<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t erase(const Key &key)
+  {
+    Node *bound = lowerBoundNode(key);
+    if (bound == nullptr || less(key, bound->data_))
+      return 0;
+
+    erase(Iterator{bound, this});
+    return 1;
+  }
+
+  // Batch versions of insert and erase. Batch is sorted and passed with a finger
+  // from the previously touched node, so each key climbs only as far as needed
+  // instead of descending from the root, iterators stay valid as with insert and
+  // erase. Batches of at least 256 keys and a quarter of the tree size are merged
+  // with its content and the tree is rebuilt in O(n + m), which invalidates all
+  // iterators.
+  // Return the number of inserted (erased) elements.
+  template <std::ranges::input_range Range>
+  size_t insertBatch(Range &&batch);
+  // Keys are taken as by erase (key): any ones if Compare is transparent, Data otherwise.
+  template <std::ranges::input_range Range>
+    requires LookupKey<std::ranges::range_value_t<Range>, Data, Compare> ||
+             std::convertible_to<std::ranges::range_value_t<Range>, Data>
+  size_t eraseBatch(Range &&keys);
+
+  // Splits the tree by key in O(log n): the first tree gets elements less than key,
+  // the second one gets all others. This tree becomes empty.
+  std::pair<StatTree, StatTree> split(const Data &key)
+  {
+    return split<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  std::pair<StatTree, StatTree> split(const Key &key);
+
+  // Joins trees with pivot between them in O(log n). All elements of left have
+  // to be less than pivot and all elements of right have to be greater.
+  static StatTree join(StatTree &&left, Data pivot, StatTree &&right);
+  // Same without pivot, all elements of left have to be less than right ones.
+  static StatTree join(StatTree &&left, StatTree &&right);
+
+  // Set operations built on split and join. Take O(m log (n / m + 1)) for sizes m <= n.
+  static StatTree setUnion(StatTree &&lhs, StatTree &&rhs);
+  static StatTree setIntersection(StatTree &&lhs, StatTree &&rhs);
+  // Elements of lhs which are not in rhs.
+  static StatTree setDifference(StatTree &&lhs, StatTree &&rhs);
+
+  // Erases all nodes in O(n).
+  void clear() noexcept;
+
+  // Replaces tree content with sorted [first, last) in O(n). Result tree is perfectly
+  // balanced. With threadsNum > 1 sub trees are linked on separate threads.
+  template <std::input_iterator It>
+    requires std::sized_sentinel_for<It, It>
+  void assignSorted(It first, It last, size_t threadsNum = 1);
+
 private:
   void transplant(Node *old, Node *replacing);
   void rRotation(Node *node);
@@ -134,50 +551,339 @@ private:
 
   void swipeColors(Node *node);
 
-  void insertFixup(Node *node);
+  // Place for the new node with key: parent and side. If equal key is found
+  // it is returned as the third value.
+  struct InsertPos
+  {
+    Node *parent_ = nullptr;
+    bool toLeft_ = true;
+    Node *equal_ = nullptr;
+  };
+  template <class Key>
+  InsertPos findInsertPos(const Key &key) const
+  {
+    return findInsertPos(key, root_);
+  }
+  // Searches in the sub tree, key has to belong to its keys range.
+  template <class Key>
+  InsertPos findInsertPos(const Key &key, Node *subRoot) const;
+
+  // Searches from finger, which is any node of the tree.
+  template <class Key>
+  InsertPos findInsertPosNear(const Key &key, Node *finger) const;
+
+  // Lowest ancestor of node (or node itself) which keys range contains key.
+  // Key has to lie on the side of node's data, so the bound of the other side
+  // already holds (greater keys by default, it suits sorted keys sequences).
+  template <class Key>
+  Node *climbFor(Node *node, const Key &key, Side side = Side::RIGHT) const;
+
+  // Batch is considered large if batchSize * LARGE_BATCH_RATIO >= size () and it
+  // has at least LARGE_BATCH_MIN_SIZE keys, so that tiny trees are not rebuilt.
+  static constexpr size_t LARGE_BATCH_RATIO = 4;
+  static constexpr size_t LARGE_BATCH_MIN_SIZE = 256;
+
+  bool isLargeBatch(size_t batchSize) const noexcept
+  {
+    return batchSize >= LARGE_BATCH_MIN_SIZE && batchSize * LARGE_BATCH_RATIO >= size_;
+  }
+
+  // Rebuilds the tree from its content merged with the sorted unique batch.
+  void mergeRebuild(const std::vector<Data> &batch);
+
+  // Replaces content with sorted unique [first, last). Content is replaced only
+  // after successful build, counters see created and released nodes.
+  template <class It>
+  void rebuildSorted(It first, It last);
+
+  // Links node to the found place and rebalances the tree.
+  void insertNode(Node *node, const InsertPos &pos);
+
+  // Updates sizes of all sub trees containing node (node excluded).
+  static void updatePathSizes(const Node *node, bool grow);
+  // Recalculates aggregates of node and all its ancestors.
+  static void updatePathAggregates(Node *node);
+
+  // Searches from finger if it is not nil and from the root otherwise.
+  template <class DataArg>
+  std::pair<Iterator, bool> insertUnique(DataArg &&data, Node *finger = nullptr);
+
+  // Returns 'true' if black height of the tree has grown.
+  bool insertFixup(Node *node);
   void eraseFixup(Node *check, Node *checkReplace);
 
+  // Links sorted nodes[lo, hi) into balanced sub tree and returns its root.
+  // Nodes on the redDepth level are red, all others are black.
+  static Node *linkSorted(Node *const *nodes, size_t lo, size_t hi, size_t depth, size_t redDepth,
+                          size_t threadsNum) noexcept;
+
+  // Lower bound node or nullptr. Makes one comparison per level.
+  template <class Key>
+  Node *lowerBoundNode(const Key &key) const;
+  // Upper bound node or nullptr.
+  template <class Key>
+  Node *upperBoundNode(const Key &key) const;
+
+  // Sub tree detached from the tree with its black height. Split and join work with
+  // such parts and use root_ as a scratch while rebalancing them.
+  struct Part
+  {
+    Node *root_ = nullptr;
+    size_t blackHeight_ = 0;
+  };
+
+  struct SplitParts
+  {
+    Part left_{};
+    Node *equal_ = nullptr;
+    Part right_{};
+  };
+
+  static size_t getBlackHeight(const Node *node);
+  static Part detach(Node *node, size_t blackHeight);
+
+  // Takes all nodes from the tree, so it becomes empty.
+  Part releasePart();
+  // Makes part content of the tree, which has to be empty.
+  void assignPart(Part part);
+
+  Part joinParts(Part left, Node *pivot, Part right);
+  Part joinParts(Part left, Part right);
+  template <class Key>
+  SplitParts splitParts(Part part, const Key &key);
+
+  Part uniteParts(Part lhs, Part rhs);
+  Part intersectParts(Part lhs, Part rhs);
+  Part subtractParts(Part lhs, Part rhs);
+
+  void destroySubtree(Node *node) noexcept;
+
+  // Number of elements less than key (or not greater than key if inclusive).
+  template <class Key>
+  size_t countBefore(const Key &key, bool inclusive) const;
+
+  // Aggregate of sub tree elements not less than key.
+  template <class Key>
+  AggregateValue aggregateFrom(const Node *node, const Key &key) const;
+  // Aggregate of sub tree elements less than key (or not greater than key if inclusive).
+  template <class Key>
+  AggregateValue aggregateTo(const Node *node, const Key &key, bool inclusive) const;
+
 public:
+  // Number of elements less than key.
+  size_t rank(const Data &key) const
+  {
+    return rank<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  size_t rank(const Key &key) const;
+
+  // Element with k elements before it (k is zero based), end() if k >= size().
+  Iterator select(size_t k) const;
+
+  // Number of elements in [lo, hi].
+  size_t countInRange(const Data &lo, const Data &hi) const
+  {
+    return countInRange<Data, Data>(lo, hi);
+  }
+  template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+  size_t countInRange(const KeyLo &lo, const KeyHi &hi) const;
+
+  // Aggregate of all elements in O(1).
+  AggregateValue aggregate() const
+  {
+    return Node::getAggregate(root_);
+  }
+
+  // Aggregate of elements less than key.
+  AggregateValue aggregateBefore(const Data &key) const
+  {
+    return aggregateBefore<Data>(key);
+  }
+  template <LookupKey<Data, Compare> Key>
+  AggregateValue aggregateBefore(const Key &key) const
+  {
+    return aggregateTo(root_, key, false);
+  }
+
+  // Aggregate of elements in [lo, hi], identity if there are none.
+  AggregateValue aggregate(const Data &lo, const Data &hi) const
+  {
+    return aggregate<Data, Data>(lo, hi);
+  }
+  template <LookupKey<Data, Compare> KeyLo, LookupKey<Data, Compare> KeyHi>
+  AggregateValue aggregate(const KeyLo &lo, const KeyHi &hi) const;
+
+  // First element which prefix aggregate (element included) satisfies pred, end() if
+  // there is no such. Pred has to be monotone: once true, true for all longer prefixes.
+  // Aggregate of the elements before the found one is stored to before if it is given.
+  template <class Pred>
+  Iterator findPrefix(Pred pred, AggregateValue *before = nullptr) const;
+
+  // Weighted select: first element which prefix aggregate is not less than bound.
+  Iterator selectByAggregate(const AggregateValue &bound) const
+  {
+    return findPrefix([&bound](const AggregateValue &prefix) { return !(prefix < bound); });
+  }
+
   // Methods from the KV task
-  size_t countLesser(const Node *node, const size_t m) const;
+  size_t countLesser(const Data &m) const
+  {
+    return rank(m);
+  }
+  // k-th smallest element (k is one based).
   Data lesserOfOrderK(size_t k) const;
 
-  // Calles bypass for all types of checks.
+  // Counters of Stats policy with current size and height. Height is found by
+  // a full pass, so it takes O(n).
+  TreeStats stats() const
+    requires Stats::ENABLED;
+
+  void resetStats() noexcept
+    requires Stats::ENABLED
+  {
+    stats_ = Stats{};
+  }
+
+  // Immutable pointer free copy for read only workloads (see frozen-tree.hh) in O(n).
+  FrozenStatTree<Data, Compare> freeze() const;
+
+  // Writes the image of the frozen copy, FrozenStatTree::load maps it back as
+  // a read only tree.
+  void save(const std::string &path) const
+    requires std::is_trivially_copyable_v<Data>;
+
+  // Reads the image written by save () into a writable tree by O(n) bulk load.
+  static StatTree load(const std::string &path, const Compare &comp = Compare{}, const Allocator &alloc = Allocator{})
+    requires std::is_trivially_copyable_v<Data>;
+
+  // Writes the tree to out in one pass through its buffer (see tree-dump.hh for
+  // formats and limits).
+  void dump(std::ostream &out, const DumpOptions &options = {}) const;
+  // Same to the file at path. Throws std::runtime_error if it can't be written.
+  void dump(const std::string &path, const DumpOptions &options = {}) const;
+
+  // Dumps only the sub tree around key: its root is levelsUp levels above the last
+  // node of the search path of key. Together with maxDepth_ it gives a window of
+  // a large tree.
+  void dumpAround(std::ostream &out, const Data &key, size_t levelsUp, const DumpOptions &options = {}) const
+  {
+    dumpAround<Data>(out, key, levelsUp, options);
+  }
+  template <LookupKey<Data, Compare> Key>
+  void dumpAround(std::ostream &out, const Key &key, size_t levelsUp, const DumpOptions &options = {}) const;
+
+  // Dumps DOT graph to tree.txt. Returns 'false' if it can't be written.
   bool dump() const;
 
-private:
-  // Passes all tree and calls callable (curNode) for all nodes.
-  // Returns 'true' in case of success pass and 'false' otherwise.
-  template <class Callable>
-  bool DFS(const Callable &callable) const;
+  // Calls visitor (const Data &, size_t depth) for all elements in Order, root depth
+  // is 0. Moves by parent links, so it takes no memory. Visitor may return Visit
+  // (see tree-traversal.hh). LEVEL order passes the top of the tree once per level,
+  // so it takes O(n log n). Returns 'false' if visitor stopped the traversal.
+  template <TraversalOrder Order, class Visitor>
+  bool traverse(Visitor &&visitor) const
+  {
+    // Lvalue visitors are kept by reference, so their state is seen by the caller.
+    DataVisitor<Visitor> dataVisitor{std::forward<Visitor>(visitor)};
+    return visitNodes<Order>(root_, 0, dataVisitor);
+  }
 
-  struct Dumper
+  // PRE order traversal on threadsNum threads. Sub trees under the top levels are
+  // passed by copies of visitor made before the traversal, which are merged back
+  // by merge (Visitor &to, Visitor &&from) at the end. Visit order is unspecified,
+  // so visitor has to start from a neutral state (e.g. zero counters). STOP stops
+  // all threads.
+  template <class Visitor, class Merge>
+  bool traverseParallel(Visitor &visitor, Merge merge, size_t threadsNum) const
   {
-    mutable size_t cout_nils;
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-    Dumper(const StatTree &tree)
-    {
-      cout_nils = 0;
+    return visitNodesParallel(visitor, merge, threadsNum, [](const Node *node) -> const Data & { return node->data_; });
+  }
 
-      std::ofstream out;
-      out.open("tree.txt");
-      if (out.is_open())
-        out << "digraph DG {" << std::endl;
-    };
-#pragma GCC diagnostic pop
-    ~Dumper()
+private:
+  // Calls data visitor for nodes.
+  template <class Visitor>
+  struct DataVisitor
+  {
+    Visitor visitor_;
+
+    Visit operator()(const Node *node, size_t depth)
     {
-      std::ofstream out("tree.txt", std::ios::app);
-      if (out.is_open())
-        out << "}" << std::endl;
+      return callVisitor(visitor_, std::as_const(node->data_), depth);
     }
-    bool operator()(const Node *node) const noexcept;
+  };
+
+  // Traversal of the sub tree with root at rootDepth, visitor (Node *, size_t depth).
+  // Climbs are bounded by root, so sub trees are passed without touching the rest.
+  template <TraversalOrder Order, class Visitor>
+  static bool visitNodes(Node *root, size_t rootDepth, Visitor &visitor);
+
+  template <class Visitor>
+  static bool visitPreOrder(Node *root, size_t rootDepth, Visitor &visitor);
+  template <class Visitor>
+  static bool visitInOrder(Node *root, size_t rootDepth, Visitor &visitor);
+  template <class Visitor>
+  static bool visitPostOrder(Node *root, size_t rootDepth, Visitor &visitor);
+  template <class Visitor>
+  static bool visitLevelOrder(Node *root, size_t rootDepth, Visitor &visitor);
+
+  // Node level version of traverseParallel: visitor (proj (Node *), size_t depth).
+  template <class Visitor, class Merge, class Proj = std::identity>
+  bool visitNodesParallel(Visitor &visitor, Merge merge, size_t threadsNum, Proj proj = {}) const;
+
+  // Buffer of the file written by dump (path).
+  static constexpr size_t DUMP_BUFFER_SIZE = 1 << 20;
+
+  // Writes sub tree records in pre-order with the format and limits of options.
+  class Dumper
+  {
+    // RB tree height is at most 2 log2 (n + 1).
+    static constexpr size_t MAX_HEIGHT = 2 * std::numeric_limits<size_t>::digits;
+
+    // Node to be written with its place.
+    struct Entry
+    {
+      const Node *node_ = nullptr;
+      uint64_t parent_ = DUMP_NO_PARENT;
+      size_t depth_ = 0;
+      bool isRight_ = false;
+    };
+
+    std::ostream &out_;
+    const DumpOptions &options_;
+    uint64_t recordsNum_ = 0;
+    size_t nilsNum_ = 0;
+    size_t nodesNum_ = 0;
+    // Records of the current path nodes.
+    uint64_t pathIds_[MAX_HEIGHT]{};
+
+  public:
+    Dumper(std::ostream &out, const DumpOptions &options) : out_{out}, options_{options}
+    {}
+
+    void dump(Node *root);
+
+    // Pre-order visitor.
+    Visit operator()(const Node *node, size_t depth);
+
+  private:
+    // Return the record number.
+    uint64_t writeNode(const Entry &entry);
+    uint64_t writeCut(const Entry &entry);
+    // DOT nil leaf.
+    void writeNil(uint64_t parent, bool isRight);
+
+    // Starts the record of entry: JSON fields before the payload or binary prefix.
+    void beginRecord(const Entry &entry, uint64_t id, uint64_t size, uint8_t flags);
+    // DOT edge from the parent.
+    void writeEdge(uint64_t parent, std::string_view child, uint64_t id, bool isRight);
+    // Key as a DOT label or JSON value: JSON numbers as is, all others quoted and escaped.
+    void writeKey(const Data &data);
   };
 };
 
 } // namespace tree
 
 #include "tree-impl.hh"
+#include "frozen-tree.hh"
 
 #endif // #ifndef TREE_HH_INCL
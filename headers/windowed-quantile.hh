@@ -0,0 +1,178 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <stdexcept>
+#include <vector>
+
+#include "tree.hh"
+
+#ifndef WINDOWED_QUANTILE_HH_INCL
+#define WINDOWED_QUANTILE_HH_INCL
+
+namespace tree
+{
+
+// Quantiles of the last window samples. Samples are kept in StatTree with their
+// sequence numbers, so equal samples are distinct keys. Ring buffer holds
+// iterators to the window nodes in arrival order: the expired node is reached
+// without a search and is replaced by the new sample in place when the sample
+// falls into the same gap between neighbours (StatTree::replace).
+template <class Data, class Compare = std::less<Data>, class Allocator = std::allocator<Data>>
+class WindowedQuantile
+{
+  struct Entry
+  {
+    Data data_;
+    uint64_t seq_;
+  };
+
+  struct EntryLess
+  {
+    [[no_unique_address]] Compare comp_{};
+
+    bool operator()(const Entry &lhs, const Entry &rhs) const
+    {
+      if (comp_(lhs.data_, rhs.data_))
+        return true;
+      if (comp_(rhs.data_, lhs.data_))
+        return false;
+      return lhs.seq_ < rhs.seq_;
+    }
+  };
+
+  using EntryAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Entry>;
+  using Tree = StatTree<Entry, EntryLess, EntryAllocator>;
+  using TreeIterator = typename Tree::Iterator;
+
+  // Sorted quantiles closer than this are reached by iteration instead of select.
+  static constexpr size_t MAX_STEP = 16;
+
+  Tree tree_;
+  std::vector<TreeIterator> ring_{};
+  size_t window_ = 0;
+  // Position of the oldest sample in a full ring.
+  size_t head_ = 0;
+  uint64_t seq_ = 0;
+
+public:
+  explicit WindowedQuantile(size_t window, const Compare &comp = Compare{}, const Allocator &alloc = Allocator{})
+    : tree_{EntryLess{comp}, EntryAllocator{alloc}}, window_{window}
+  {
+    if (window_ == 0)
+      throw std::invalid_argument{"WindowedQuantile: window has to be positive"};
+
+    ring_.reserve(window_);
+    tree_.reserve(window_);
+  }
+
+  // Ring refers to the nodes of its own tree.
+  WindowedQuantile(const WindowedQuantile &) = delete;
+  WindowedQuantile &operator=(const WindowedQuantile &) = delete;
+
+  size_t window() const noexcept
+  {
+    return window_;
+  }
+
+  size_t size() const noexcept
+  {
+    return tree_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return tree_.empty();
+  }
+
+  // Adds the sample, the oldest one expires if the window is full.
+  void push(const Data &data)
+  {
+    Entry entry{data, seq_++};
+    if (ring_.size() < window_)
+    {
+      ring_.push_back(tree_.insert(std::move(entry)).first);
+      return;
+    }
+
+    ring_[head_] = tree_.replace(ring_[head_], std::move(entry)).first;
+    head_ = head_ + 1 == window_ ? 0 : head_ + 1;
+  }
+
+  // Sample with k samples before it in order (k is zero based).
+  const Data &kth(size_t k) const
+  {
+    if (k >= size())
+      throw std::out_of_range{"WindowedQuantile: k is out of range"};
+    return tree_.select(k)->data_;
+  }
+
+  // Nearest rank quantile: the smallest sample with at least q * size () samples
+  // not greater than it. q has to be in [0, 1].
+  const Data &quantile(double q) const
+  {
+    return kth(quantileIndex(q));
+  }
+
+  const Data &median() const
+  {
+    return quantile(0.5);
+  }
+
+  // Writes quantiles for all qs to out. Nondecreasing qs close to each other
+  // share the descent.
+  template <std::ranges::input_range Range, std::output_iterator<const Data &> Out>
+  Out quantiles(const Range &qs, Out out) const;
+
+  void clear() noexcept
+  {
+    tree_.clear();
+    ring_.clear();
+    head_ = 0;
+  }
+
+private:
+  size_t quantileIndex(double q) const
+  {
+    if (empty())
+      throw std::out_of_range{"WindowedQuantile: window is empty"};
+    if (!(q >= 0 && q <= 1))
+      throw std::out_of_range{"WindowedQuantile: quantile is out of [0, 1]"};
+
+    auto rank = static_cast<size_t>(std::ceil(q * static_cast<double>(size())));
+    return std::clamp<size_t>(rank, 1, size()) - 1;
+  }
+};
+
+template <class Data, class Compare, class Allocator>
+template <std::ranges::input_range Range, std::output_iterator<const Data &> Out>
+Out WindowedQuantile<Data, Compare, Allocator>::quantiles(const Range &qs, Out out) const
+{
+  TreeIterator it{};
+  size_t idx = 0;
+  bool found = false;
+
+  for (double q : qs)
+  {
+    size_t next = quantileIndex(q);
+    if (found && next >= idx && next - idx <= MAX_STEP)
+      std::advance(it, next - idx);
+    else
+      it = tree_.select(next);
+
+    idx = next;
+    found = true;
+    *out++ = it->data_;
+  }
+
+  return out;
+}
+
+} // namespace tree
+
+#endif // #ifndef WINDOWED_QUANTILE_HH_INCL
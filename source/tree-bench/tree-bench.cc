@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "block-tree.hh"
+#include "compact-tree.hh"
+#include "concurrent-tree.hh"
+#include "tree.hh"
+#include "windowed-quantile.hh"
+
+namespace
+{
+
+enum class Distribution
+{
+  SEQUENTIAL,
+  // Distinct keys in random order, as genTest.py does.
+  SHUFFLED,
+  // Few hot keys are met much more often than others.
+  ZIPFIAN,
+  // Sorted keys with small jitter, as timestamps arrive.
+  ALMOST_SORTED
+};
+
+constexpr const char *DISTRIBUTION_NAMES[] = {"sequential", "shuffled", "zipfian", "almost_sorted"};
+// Keys of ALMOST_SORTED are moved by up to JITTER positions.
+constexpr size_t JITTER = 8;
+constexpr size_t MIN_SIZE = 1000;
+constexpr uint64_t SEED = 0x5EED;
+
+std::vector<int> genKeys(size_t n, Distribution dist, uint64_t seed)
+{
+  std::vector<int> keys(n);
+  std::mt19937_64 gen{seed};
+
+  switch (dist)
+  {
+  case Distribution::SEQUENTIAL:
+    for (size_t i = 0; i < n; ++i)
+      keys[i] = static_cast<int>(i);
+    break;
+  case Distribution::SHUFFLED:
+    for (size_t i = 0; i < n; ++i)
+      keys[i] = static_cast<int>(i);
+    std::shuffle(std::begin(keys), std::end(keys), gen);
+    break;
+  case Distribution::ZIPFIAN: {
+    // Continuous approximation of Zipf's law with s = 1: P(rank <= x) = ln(x) / ln(n + 1).
+    // Ranks are scattered over the keys space, so hot keys are not neighbours.
+    std::uniform_real_distribution<double> uniform{0, 1};
+    double logRange = std::log(static_cast<double>(n) + 1);
+    for (auto &key : keys)
+    {
+      auto rank = static_cast<uint64_t>(std::exp(uniform(gen) * logRange));
+      key = static_cast<int>((rank * 2654435761u) % static_cast<uint64_t>(n));
+    }
+    break;
+  }
+  case Distribution::ALMOST_SORTED:
+    for (size_t i = 0; i < n; ++i)
+      keys[i] = static_cast<int>(i);
+    for (size_t i = 0; i < n; ++i)
+      std::swap(keys[i], keys[std::min(n - 1, i + gen() % JITTER)]);
+    break;
+  }
+
+  return keys;
+}
+
+// Uniform access to the containers under test.
+template <class Container>
+struct Ops
+{
+  static void insert(Container &cont, int key)
+  {
+    cont.insert(key);
+  }
+
+  static void erase(Container &cont, int key)
+  {
+    cont.erase(key);
+  }
+
+  static bool contains(const Container &cont, int key)
+  {
+    return cont.find(key) != cont.end();
+  }
+};
+
+template <>
+struct Ops<tree::CompactStatTree<int>>
+{
+  using Container = tree::CompactStatTree<int>;
+
+  static void insert(Container &cont, int key)
+  {
+    cont.insert(key);
+  }
+
+  static void erase(Container &cont, int key)
+  {
+    cont.erase(cont.find(key));
+  }
+
+  static bool contains(const Container &cont, int key)
+  {
+    return cont.find(key) != cont.end();
+  }
+};
+
+template <class Container>
+Container build(const std::vector<int> &keys)
+{
+  Container cont{};
+  for (int key : keys)
+    Ops<Container>::insert(cont, key);
+  return cont;
+}
+
+// Frozen trees are built from StatTree.
+template <>
+tree::FrozenStatTree<int, std::less<int>> build(const std::vector<int> &keys)
+{
+  return build<tree::StatTree<int>>(keys).freeze();
+}
+
+template <class Container>
+void benchInsert(benchmark::State &state, Distribution dist)
+{
+  auto keys = genKeys(static_cast<size_t>(state.range(0)), dist, SEED);
+
+  for (auto _ : state)
+  {
+    Container cont{};
+    for (int key : keys)
+      Ops<Container>::insert(cont, key);
+    benchmark::DoNotOptimize(cont.size());
+
+    // Destruction is not measured.
+    state.PauseTiming();
+    cont = Container{};
+    state.ResumeTiming();
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Inserts with the iterator returned by the previous insert as the hint.
+template <class Container>
+void benchHintedInsert(benchmark::State &state, Distribution dist)
+{
+  auto keys = genKeys(static_cast<size_t>(state.range(0)), dist, SEED);
+
+  for (auto _ : state)
+  {
+    Container cont{};
+    auto hint = cont.end();
+    for (int key : keys)
+      hint = cont.insert(hint, key);
+    benchmark::DoNotOptimize(cont.size());
+
+    state.PauseTiming();
+    cont = Container{};
+    state.ResumeTiming();
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class Container>
+void benchErase(benchmark::State &state, Distribution dist)
+{
+  auto keys = genKeys(static_cast<size_t>(state.range(0)), dist, SEED);
+  auto toErase = keys;
+  std::shuffle(std::begin(toErase), std::end(toErase), std::mt19937_64{SEED + 1});
+
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    auto cont = build<Container>(keys);
+    state.ResumeTiming();
+
+    for (int key : toErase)
+      Ops<Container>::erase(cont, key);
+    benchmark::DoNotOptimize(cont.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class Container>
+void benchFind(benchmark::State &state, Distribution dist)
+{
+  auto keys = genKeys(static_cast<size_t>(state.range(0)), dist, SEED);
+  auto cont = build<Container>(keys);
+  // Queries follow the same distribution, some of them miss.
+  auto queries = genKeys(keys.size(), dist, SEED + 1);
+
+  size_t idx = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(Ops<Container>::contains(cont, queries[idx]));
+    idx = idx + 1 == queries.size() ? 0 : idx + 1;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <class Container>
+void benchRank(benchmark::State &state, Distribution dist)
+{
+  auto keys = genKeys(static_cast<size_t>(state.range(0)), dist, SEED);
+  auto cont = build<Container>(keys);
+  auto queries = genKeys(keys.size(), dist, SEED + 1);
+
+  size_t idx = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(cont.rank(queries[idx]));
+    idx = idx + 1 == queries.size() ? 0 : idx + 1;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <class Container>
+void benchSelect(benchmark::State &state, Distribution dist)
+{
+  auto keys = genKeys(static_cast<size_t>(state.range(0)), dist, SEED);
+  auto cont = build<Container>(keys);
+
+  std::vector<size_t> orders(cont.size());
+  std::mt19937_64 gen{SEED + 1};
+  std::uniform_int_distribution<size_t> order{0, cont.size() - 1};
+  for (auto &k : orders)
+    k = order(gen);
+
+  size_t idx = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(*cont.select(orders[idx]));
+    idx = idx + 1 == orders.size() ? 0 : idx + 1;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <class Container>
+void benchIterate(benchmark::State &state, Distribution dist)
+{
+  auto cont = build<Container>(genKeys(static_cast<size_t>(state.range(0)), dist, SEED));
+
+  for (auto _ : state)
+  {
+    int64_t sum = 0;
+    for (int key : cont)
+      sum += key;
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(cont.size()));
+}
+
+// Readers scalability: all threads query one tree, thread 0 also inserts and
+// erases odd keys if withWriter is set.
+void benchConcurrentRank(benchmark::State &state, bool withWriter)
+{
+  static std::unique_ptr<tree::ConcurrentStatTree<int>> cont{};
+  auto size = static_cast<size_t>(state.range(0));
+
+  if (state.thread_index() == 0)
+  {
+    cont = std::make_unique<tree::ConcurrentStatTree<int>>();
+    for (int key : genKeys(size, Distribution::SHUFFLED, SEED))
+      cont->insert(key * 2);
+  }
+  auto queries = genKeys(size, Distribution::SHUFFLED, SEED + static_cast<uint64_t>(state.thread_index()));
+  bool isWriter = withWriter && state.thread_index() == 0;
+
+  size_t idx = 0;
+  for (auto _ : state)
+  {
+    if (isWriter)
+    {
+      cont->insert(queries[idx] * 2 + 1);
+      cont->erase(queries[idx] * 2 + 1);
+    }
+    else
+      benchmark::DoNotOptimize(cont->rank(queries[idx] * 2));
+    idx = idx + 1 == queries.size() ? 0 : idx + 1;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Sliding window median: every update pushes a sample and queries the median.
+void benchWindowedMedian(benchmark::State &state, Distribution dist)
+{
+  auto window = static_cast<size_t>(state.range(0));
+  auto samples = genKeys(window * 2, dist, SEED);
+
+  tree::WindowedQuantile<int> cont{window};
+  for (size_t i = 0; i < window; ++i)
+    cont.push(samples[i]);
+
+  size_t idx = window;
+  for (auto _ : state)
+  {
+    cont.push(samples[idx]);
+    benchmark::DoNotOptimize(cont.median());
+    idx = idx + 1 == samples.size() ? 0 : idx + 1;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <class Bench>
+void registerBench(const std::string &name, Bench bench, size_t maxSize)
+{
+  for (size_t i = 0; i < std::size(DISTRIBUTION_NAMES); ++i)
+  {
+    auto dist = static_cast<Distribution>(i);
+    auto *registered =
+      benchmark::RegisterBenchmark((name + "/" + DISTRIBUTION_NAMES[i]).c_str(),
+                                   [bench, dist](benchmark::State &state) { bench(state, dist); });
+
+    for (size_t size = MIN_SIZE; size <= maxSize; size *= 10)
+      registered->Arg(static_cast<int64_t>(size));
+  }
+}
+
+template <class Container>
+void registerCommon(const std::string &name, size_t maxSize)
+{
+  registerBench(name + "/insert", benchInsert<Container>, maxSize);
+  registerBench(name + "/erase", benchErase<Container>, maxSize);
+  registerBench(name + "/find", benchFind<Container>, maxSize);
+  registerBench(name + "/iterate", benchIterate<Container>, maxSize);
+}
+
+template <class Container>
+void registerStat(const std::string &name, size_t maxSize)
+{
+  registerCommon<Container>(name, maxSize);
+  registerBench(name + "/rank", benchRank<Container>, maxSize);
+  registerBench(name + "/select", benchSelect<Container>, maxSize);
+}
+
+} // namespace
+
+// Accepts --max_size=N (1e6 by default, up to 1e8) besides google benchmark flags.
+// Results are printed as JSON unless --benchmark_format is given.
+int main(int argc, char **argv)
+{
+  constexpr std::string_view MAX_SIZE_FLAG{"--max_size="};
+  constexpr std::string_view FORMAT_FLAG{"--benchmark_format="};
+
+  size_t maxSize = 1000000;
+  bool hasFormat = false;
+
+  std::vector<char *> args{argv[0]};
+  std::string jsonFormat{std::string{FORMAT_FLAG} + "json"};
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view arg{argv[i]};
+    if (arg.starts_with(MAX_SIZE_FLAG))
+    {
+      maxSize = static_cast<size_t>(std::strtod(argv[i] + MAX_SIZE_FLAG.size(), nullptr));
+      continue;
+    }
+    hasFormat = hasFormat || arg.starts_with(FORMAT_FLAG);
+    args.push_back(argv[i]);
+  }
+  if (!hasFormat)
+    args.push_back(jsonFormat.data());
+
+  if (maxSize < MIN_SIZE || maxSize > 100000000)
+  {
+    std::cerr << "--max_size should be in [1e3, 1e8]" << std::endl;
+    return 1;
+  }
+
+  registerStat<tree::StatTree<int>>("StatTree", maxSize);
+  registerBench("StatTree/insert_hint", benchHintedInsert<tree::StatTree<int>>, maxSize);
+  registerStat<tree::CompactStatTree<int>>("CompactStatTree", maxSize);
+  registerStat<tree::BlockStatTree<int>>("BlockStatTree", maxSize);
+
+  using Frozen = tree::FrozenStatTree<int, std::less<int>>;
+  registerBench("FrozenStatTree/find", benchFind<Frozen>, maxSize);
+  registerBench("FrozenStatTree/rank", benchRank<Frozen>, maxSize);
+  registerBench("FrozenStatTree/select", benchSelect<Frozen>, maxSize);
+  registerCommon<std::set<int>>("std::set", maxSize);
+  registerBench("std::set/insert_hint", benchHintedInsert<std::set<int>>, maxSize);
+  registerBench("WindowedQuantile/median", benchWindowedMedian, std::min<size_t>(maxSize, 1000000));
+
+  for (bool withWriter : {false, true})
+    benchmark::RegisterBenchmark(withWriter ? "ConcurrentStatTree/rank/writer" : "ConcurrentStatTree/rank",
+                                 [withWriter](benchmark::State &state) { benchConcurrentRank(state, withWriter); })
+      ->Arg(static_cast<int64_t>(std::min<size_t>(maxSize, 1000000)))
+      ->ThreadRange(1, static_cast<int>(std::max(2u, std::thread::hardware_concurrency())))
+      ->UseRealTime();
+
+  int argsNum = static_cast<int>(args.size());
+  benchmark::Initialize(&argsNum, args.data());
+  if (benchmark::ReportUnrecognizedArguments(argsNum, args.data()))
+    return 1;
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,301 @@
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "tree-io.hh"
+
+namespace tree::io
+{
+
+namespace
+{
+constexpr uint64_t ONES = 0x0101010101010101;
+
+bool isSpace(char c) noexcept
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+uint64_t loadWord(const char *ptr) noexcept
+{
+  uint64_t word = 0;
+  std::memcpy(&word, ptr, sizeof(word));
+  return word;
+}
+
+// All 8 bytes are '0'..'9'.
+bool isEightDigits(uint64_t word) noexcept
+{
+  return ((word & (ONES * 0xF0)) | (((word + ONES * 0x06) & (ONES * 0xF0)) >> 4)) == ONES * 0x33;
+}
+
+// Value of 8 digits, the first digit is in the lowest byte.
+uint64_t parseEightDigits(uint64_t word) noexcept
+{
+  word = ((word & (ONES * 0x0F)) * 2561) >> 8;
+  word = ((word & 0x00FF00FF00FF00FF) * 6553601) >> 16;
+  return ((word & 0x0000FFFF0000FFFF) * 42949672960001) >> 32;
+}
+
+void putLE(char *out, uint64_t value, size_t size) noexcept
+{
+  for (size_t i = 0; i < size; ++i, value >>= 8)
+    out[i] = static_cast<char>(value & 0xFF);
+}
+
+uint64_t getLE(const char *in, size_t size) noexcept
+{
+  uint64_t value = 0;
+  for (size_t i = size; i > 0; --i)
+    value = (value << 8) | static_cast<unsigned char>(in[i - 1]);
+  return value;
+}
+
+} // namespace
+
+bool parseInt(const char *&cur, const char *end, int64_t &num) noexcept
+{
+  while (cur != end && isSpace(*cur))
+    ++cur;
+  if (cur == end)
+    return false;
+
+  const char *start = cur;
+  bool negative = *cur == '-';
+  if (negative || *cur == '+')
+    ++cur;
+
+  // Magnitude of the minimal int64_t is one more than of the maximal one.
+  const uint64_t limit = static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + (negative ? 1u : 0u);
+  // Appends digits to value multiplied by scale, 'false' if it leaves int64_t range.
+  auto append = [limit](uint64_t &value, uint64_t scale, uint64_t digits) noexcept {
+    if (value > (limit - digits) / scale)
+      return false;
+    value = value * scale + digits;
+    return true;
+  };
+
+  const char *begin = cur;
+  uint64_t value = 0;
+  bool inRange = true;
+  if constexpr (std::endian::native == std::endian::little)
+    while (inRange && end - cur >= 8)
+    {
+      uint64_t word = loadWord(cur);
+      if (!isEightDigits(word))
+        break;
+      inRange = append(value, 100000000, parseEightDigits(word));
+      cur += 8;
+    }
+
+  for (; inRange && cur != end && *cur >= '0' && *cur <= '9'; ++cur)
+    inRange = append(value, 10, static_cast<uint64_t>(*cur - '0'));
+
+  if (!inRange || cur == begin)
+  {
+    cur = start;
+    return false;
+  }
+
+  // Conversion is modular, so the minimal int64_t is obtained as well.
+  num = static_cast<int64_t>(negative ? 0 - value : value);
+  return true;
+}
+
+InputData InputData::mapFile(const std::string &path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::system_error{errno, std::generic_category(), "can't open " + path};
+
+  struct stat fileStat
+  {};
+  if (::fstat(fd, &fileStat) != 0)
+  {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error{err, std::generic_category(), "can't stat " + path};
+  }
+
+  InputData input{};
+  input.size_ = static_cast<size_t>(fileStat.st_size);
+  if (input.size_ != 0)
+  {
+    void *mapped = ::mmap(nullptr, input.size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+      int err = errno;
+      ::close(fd);
+      throw std::system_error{err, std::generic_category(), "can't map " + path};
+    }
+
+    // Input is read once from the beginning to the end.
+    ::madvise(mapped, input.size_, MADV_SEQUENTIAL);
+    input.data_ = static_cast<const char *>(mapped);
+    input.isMapped_ = true;
+  }
+
+  ::close(fd);
+  return input;
+}
+
+InputData InputData::readStdin()
+{
+  constexpr size_t READ_SIZE = 1 << 20;
+
+  InputData input{};
+  size_t readNum = 0;
+  do
+  {
+    input.buffer_.resize(input.buffer_.size() + READ_SIZE);
+    readNum = std::fread(input.buffer_.data() + input.size_, 1, READ_SIZE, stdin);
+    input.size_ += readNum;
+  } while (readNum == READ_SIZE);
+
+  if (std::ferror(stdin))
+    throw std::runtime_error{"can't read stdin"};
+
+  input.buffer_.resize(input.size_);
+  input.data_ = input.buffer_.data();
+  return input;
+}
+
+InputData::InputData(InputData &&sd) noexcept
+  : data_{sd.data_}, size_{sd.size_}, isMapped_{sd.isMapped_}, buffer_{std::move(sd.buffer_)}
+{
+  if (!isMapped_)
+    data_ = buffer_.data();
+
+  sd.data_ = nullptr;
+  sd.size_ = 0;
+  sd.isMapped_ = false;
+}
+
+InputData::~InputData()
+{
+  if (isMapped_)
+    ::munmap(const_cast<char *>(data_), size_);
+}
+
+OpReader::OpReader(std::string_view input) : input_{input}
+{
+  if (input_.starts_with(BINARY_MAGIC))
+  {
+    isBinary_ = true;
+    if (input_.size() < BINARY_MAGIC.size() + sizeof(uint64_t))
+      throw std::runtime_error{"binary op log header is truncated"};
+
+    left_ = getLE(input_.data() + BINARY_MAGIC.size(), sizeof(uint64_t));
+    pos_ = BINARY_MAGIC.size() + sizeof(uint64_t);
+    if ((input_.size() - pos_) / BINARY_RECORD_SIZE < left_)
+      throw std::runtime_error{"binary op log is truncated"};
+    return;
+  }
+
+  int64_t insertsNum = 0;
+  if (parseInt(insertsNum))
+  {
+    if (insertsNum < 0)
+      throw std::runtime_error{"negative inserts number"};
+    left_ = static_cast<uint64_t>(insertsNum);
+  }
+}
+
+bool OpReader::next(Op &op)
+{
+  if (isBinary_)
+  {
+    if (left_ == 0)
+      return false;
+
+    const char *record = input_.data() + pos_;
+    op.code_ = static_cast<OpCode>(record[0]);
+    op.key_ = static_cast<int>(static_cast<int32_t>(getLE(record + 1, sizeof(int32_t))));
+    if (op.code_ > OpCode::SELECT)
+      throw std::runtime_error{"unknown op code in binary op log"};
+
+    pos_ += BINARY_RECORD_SIZE;
+    --left_;
+    return true;
+  }
+
+  // Erases section starts after all inserts.
+  if (left_ == 0 && textCode_ == OpCode::INSERT)
+  {
+    textCode_ = OpCode::ERASE;
+
+    int64_t erasesNum = 0;
+    if (!parseInt(erasesNum))
+      return false;
+    if (erasesNum < 0)
+      throw std::runtime_error{"negative erases number"};
+    left_ = static_cast<uint64_t>(erasesNum);
+  }
+
+  if (left_ == 0)
+    return false;
+
+  int64_t key = 0;
+  if (!parseInt(key))
+    throw std::runtime_error{"input is over before all keys are read"};
+
+  if (key < std::numeric_limits<int>::min() || key > std::numeric_limits<int>::max())
+    throw std::runtime_error{"key is out of int range at position " + std::to_string(pos_)};
+
+  op.code_ = textCode_;
+  op.key_ = static_cast<int>(key);
+  --left_;
+  return true;
+}
+
+bool OpReader::parseInt(int64_t &num)
+{
+  const char *cur = input_.data() + pos_;
+  const char *end = input_.data() + input_.size();
+
+  bool parsed = io::parseInt(cur, end, num);
+  pos_ = static_cast<size_t>(cur - input_.data());
+
+  if (!parsed && cur != end)
+    throw std::runtime_error{"integer in int64_t range is expected at position " + std::to_string(pos_)};
+  return parsed;
+}
+
+void writeBinary(const std::string &path, OpReader &reader)
+{
+  std::ofstream out{path, std::ios::binary};
+  if (!out.is_open())
+    throw std::runtime_error{"can't open " + path};
+
+  char header[BINARY_MAGIC.size() + sizeof(uint64_t)]{};
+  std::memcpy(header, BINARY_MAGIC.data(), BINARY_MAGIC.size());
+  out.write(header, sizeof(header));
+
+  uint64_t opsNum = 0;
+  char record[BINARY_RECORD_SIZE]{};
+  for (Op op{}; reader.next(op); ++opsNum)
+  {
+    record[0] = static_cast<char>(op.code_);
+    putLE(record + 1, static_cast<uint32_t>(op.key_), sizeof(int32_t));
+    out.write(record, sizeof(record));
+  }
+
+  // Ops number is known only now.
+  putLE(header + BINARY_MAGIC.size(), opsNum, sizeof(uint64_t));
+  out.seekp(0);
+  out.write(header, sizeof(header));
+
+  if (!out)
+    throw std::runtime_error{"can't write " + path};
+}
+
+} // namespace tree::io
@@ -1,28 +1,134 @@
-
+#include <chrono>
+#include <concepts>
+#include <cstring>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <string>
 
+#include "tree-io.hh"
 #include "tree.hh"
 
-int main()
+namespace
+{
+
+void printUsage(const char *name)
+{
+  std::cerr << "Usage: " << name << " [--dump] [--stats] [input]\n"
+            << "       " << name << " --convert <text input> <binary output>\n"
+            << "Input is the text task format or binary op log, stdin if omitted.\n"
+            << "Tree is dumped to tree.txt with --dump or when it is read from stdin.\n"
+            << "With --stats tree operations are counted and printed after the replay.\n";
+}
+
+using CountedTree = tree::StatTree<int, std::less<int>, std::allocator<int>, tree::NoAggregate, tree::CountingStats>;
+
+// Applies all ops to the tree. Returns the number of applied ops and
+// accumulates query results to checksum.
+template <class Tree>
+size_t replay(Tree &tree, tree::io::OpReader &reader, size_t &checksum)
 {
-  tree::StatTree<int> tree{};
-  int n = 0;
-  std::cin >> n;
-  for (int i = 0; i < n; ++i)
+  using tree::io::OpCode;
+
+  size_t opsNum = 0;
+  for (tree::io::Op op{}; reader.next(op); ++opsNum)
   {
-    int num = 0;
-    std::cin >> num;
-    tree.insert(num);
+    switch (op.code_)
+    {
+    case OpCode::INSERT:
+      tree.insert(op.key_);
+      break;
+    case OpCode::ERASE:
+      tree.erase(op.key_);
+      break;
+    case OpCode::FIND:
+      checksum += tree.find(op.key_) != tree.end();
+      break;
+    case OpCode::RANK:
+      checksum += tree.rank(op.key_);
+      break;
+    case OpCode::SELECT: {
+      auto it = tree.select(static_cast<size_t>(op.key_));
+      checksum += it == tree.end() ? 0 : static_cast<size_t>(*it);
+      break;
+    }
+    }
   }
 
-  std::cin >> n;
-  for (int i = 0; i < n; ++i)
+  return opsNum;
+}
+
+// Replays all ops to a new tree and reports the results to stderr.
+template <class Tree>
+void run(tree::io::OpReader &reader, bool toDump)
+{
+  Tree tree{};
+  size_t checksum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  size_t opsNum = replay(tree, reader, checksum);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cerr << opsNum << " ops in " << elapsed.count() << " s ("
+            << (elapsed.count() > 0 ? static_cast<double>(opsNum) / elapsed.count() : 0) << " ops/s), size "
+            << tree.size() << ", checksum " << checksum << std::endl;
+
+  if constexpr (std::same_as<Tree, CountedTree>)
+    std::cerr << tree.stats();
+
+  if (toDump)
+    tree.dump();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  try
+  {
+    if (argc == 4 && std::strcmp(argv[1], "--convert") == 0)
+    {
+      auto input = tree::io::InputData::mapFile(argv[2]);
+      tree::io::OpReader reader{input.view()};
+      tree::io::writeBinary(argv[3], reader);
+      return 0;
+    }
+
+    bool toDump = false;
+    bool toCount = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+      if (std::strcmp(argv[i], "--dump") == 0)
+        toDump = true;
+      else if (std::strcmp(argv[i], "--stats") == 0)
+        toCount = true;
+      else if (path == nullptr && argv[i][0] != '-')
+        path = argv[i];
+      else
+      {
+        printUsage(argv[0]);
+        return 1;
+      }
+    }
+
+    // Stdin mode keeps the old behaviour with dump.
+    auto input = path == nullptr ? tree::io::InputData::readStdin() : tree::io::InputData::mapFile(path);
+    toDump = toDump || path == nullptr;
+
+    tree::io::OpReader reader{input.view()};
+    // Counting is a different tree type, so the plain replay pays nothing for it.
+    if (toCount)
+      run<CountedTree>(reader, toDump);
+    else
+      run<tree::StatTree<int>>(reader, toDump);
+  }
+  catch (const std::exception &exc)
   {
-    int num = 0;
-    std::cin >> num;
-    tree.erase(tree.find(num));
+    std::cerr << "Error: " << exc.what() << std::endl;
+    return 1;
   }
 
-  tree.dump();
   return 0;
-}
\ No newline at end of file
+}
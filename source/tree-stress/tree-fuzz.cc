@@ -0,0 +1,27 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+#include "diff-checker.hh"
+
+// libFuzzer entry: every input is a valid op stream (see DiffChecker::decode),
+// a mismatch with the references aborts. Crash inputs are replayed with
+// treeStress --replay.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  // Inputs are short, so invariants are checked after every op.
+  tree::DiffChecker checker{1};
+
+  std::string_view bytes{reinterpret_cast<const char *>(data), size};
+  tree::io::Op op{};
+  while (tree::DiffChecker::decode(bytes, op))
+    if (!checker.apply(op))
+    {
+      std::cerr << checker.failure() << std::endl;
+      std::abort();
+    }
+
+  return 0;
+}
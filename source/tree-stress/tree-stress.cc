@@ -0,0 +1,135 @@
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "diff-checker.hh"
+#include "tree-io.hh"
+
+namespace
+{
+
+constexpr const char *OP_NAMES[]{"insert", "erase", "find", "rank", "select"};
+
+void printUsage(const char *name)
+{
+  std::cerr << "Usage: " << name << " [--seed N] [--ops N] [--keys N] [--check-every N]\n"
+            << "       " << name << " --replay <fuzzer input>\n"
+            << "Applies random ops to StatTree, StatMultiset and std references and compares\n"
+            << "their answers, invariants are checked every --check-every ops. The seed is\n"
+            << "printed first, the same seed replays the same ops. --replay applies ops decoded\n"
+            << "from a file as the fuzzer does.\n";
+}
+
+struct Options
+{
+  uint64_t seed_ = std::random_device{}();
+  size_t opsNum_ = 1'000'000;
+  size_t keysNum_ = 1 << 10;
+  size_t checkPeriod_ = 10'000;
+  const char *replayPath_ = nullptr;
+};
+
+void reportFailure(const tree::DiffChecker &checker, size_t opIdx, const tree::io::Op &op)
+{
+  std::cerr << "FAILED at op #" << opIdx << " (" << OP_NAMES[static_cast<size_t>(op.code_)] << " " << op.key_
+            << "): " << checker.failure() << std::endl;
+}
+
+int runRandom(const Options &options)
+{
+  std::cerr << "seed " << options.seed_ << std::endl;
+
+  std::mt19937_64 rEng{options.seed_};
+  // Inserts and erases are equally likely, so the multiset does not grow forever.
+  std::discrete_distribution<int> codes{2, 2, 1, 1, 1};
+  std::uniform_int_distribution<int> keys{0, static_cast<int>(options.keysNum_ - 1)};
+
+  tree::DiffChecker checker{options.checkPeriod_};
+  auto start = std::chrono::steady_clock::now();
+  for (size_t opIdx = 0; opIdx < options.opsNum_; ++opIdx)
+  {
+    tree::io::Op op{static_cast<tree::io::OpCode>(codes(rEng)), keys(rEng)};
+    if (!checker.apply(op))
+    {
+      reportFailure(checker, opIdx, op);
+      std::cerr << "replay with --seed " << options.seed_ << " --ops " << opIdx + 1 << std::endl;
+      return 1;
+    }
+  }
+
+  if (!checker.check())
+  {
+    std::cerr << "FAILED at the end: " << checker.failure() << std::endl;
+    return 1;
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cerr << options.opsNum_ << " ops passed in " << elapsed.count() << " s" << std::endl;
+  return 0;
+}
+
+int runReplay(const char *path)
+{
+  auto input = tree::io::InputData::mapFile(path);
+  std::string_view bytes = input.view();
+
+  tree::DiffChecker checker{1};
+  tree::io::Op op{};
+  for (size_t opIdx = 0; tree::DiffChecker::decode(bytes, op); ++opIdx)
+    if (!checker.apply(op))
+    {
+      reportFailure(checker, opIdx, op);
+      return 1;
+    }
+
+  std::cerr << "replay passed" << std::endl;
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  try
+  {
+    Options options{};
+    for (int i = 1; i < argc; ++i)
+    {
+      bool hasValue = i + 1 < argc;
+      if (hasValue && std::strcmp(argv[i], "--seed") == 0)
+        options.seed_ = std::stoull(argv[++i]);
+      else if (hasValue && std::strcmp(argv[i], "--ops") == 0)
+        options.opsNum_ = std::stoull(argv[++i]);
+      else if (hasValue && std::strcmp(argv[i], "--keys") == 0)
+        options.keysNum_ = std::stoull(argv[++i]);
+      else if (hasValue && std::strcmp(argv[i], "--check-every") == 0)
+        options.checkPeriod_ = std::stoull(argv[++i]);
+      else if (hasValue && std::strcmp(argv[i], "--replay") == 0)
+        options.replayPath_ = argv[++i];
+      else
+      {
+        printUsage(argv[0]);
+        return 1;
+      }
+    }
+
+    if (options.keysNum_ == 0 || options.keysNum_ > static_cast<size_t>(std::numeric_limits<int>::max()))
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+
+    return options.replayPath_ != nullptr ? runReplay(options.replayPath_) : runRandom(options);
+  }
+  catch (const std::exception &exc)
+  {
+    std::cerr << "Error: " << exc.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,107 @@
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "tree-io.hh"
+
+namespace tree::io
+{
+
+TEST(TreeIOTests, ParseIntTest)
+{
+  std::string input{"  0 7 -15\n12345678 123456789012 +42\t-9876543210 x"};
+  const char *cur = input.data();
+  const char *end = input.data() + input.size();
+
+  std::vector<int64_t> parsed{};
+  for (int64_t num = 0; parseInt(cur, end, num);)
+    parsed.push_back(num);
+
+  std::vector<int64_t> expected{0, 7, -15, 12345678, 123456789012, 42, -9876543210};
+  ASSERT_EQ(parsed, expected);
+  ASSERT_EQ(*cur, 'x');
+
+  std::string limits{"9223372036854775807 -9223372036854775808 9223372036854775808"};
+  cur = limits.data();
+  end = limits.data() + limits.size();
+  int64_t num = 0;
+  ASSERT_TRUE(parseInt(cur, end, num));
+  ASSERT_EQ(num, std::numeric_limits<int64_t>::max());
+  ASSERT_TRUE(parseInt(cur, end, num));
+  ASSERT_EQ(num, std::numeric_limits<int64_t>::min());
+  ASSERT_FALSE(parseInt(cur, end, num));
+  ASSERT_EQ(*cur, '9');
+
+  std::string overflow{"-99999999999999999999"};
+  cur = overflow.data();
+  end = overflow.data() + overflow.size();
+  ASSERT_FALSE(parseInt(cur, end, num));
+  ASSERT_EQ(cur, overflow.data());
+  for (std::string signOnly : {"-", "5 -", "+ 5"})
+  {
+    cur = signOnly.data();
+    end = signOnly.data() + signOnly.size();
+    if (*cur == '5')
+    {
+      ASSERT_TRUE(parseInt(cur, end, num));
+    }
+    ASSERT_FALSE(parseInt(cur, end, num));
+    ASSERT_TRUE(*cur == '-' || *cur == '+');
+  }
+}
+
+TEST(TreeIOTests, TextAndBinaryTest)
+{
+  std::string text{"4\n5 3 8 1\n2\n3 8\n"};
+  std::vector<Op> expected{{OpCode::INSERT, 5}, {OpCode::INSERT, 3}, {OpCode::INSERT, 8},
+                           {OpCode::INSERT, 1}, {OpCode::ERASE, 3},  {OpCode::ERASE, 8}};
+
+  auto readAll = [](OpReader &reader) {
+    std::vector<Op> ops{};
+    for (Op op{}; reader.next(op);)
+      ops.push_back(op);
+    return ops;
+  };
+  auto equalOps = [](const Op &lhs, const Op &rhs) { return lhs.code_ == rhs.code_ && lhs.key_ == rhs.key_; };
+
+  OpReader textReader{text};
+  ASSERT_FALSE(textReader.isBinary());
+  auto textOps = readAll(textReader);
+  ASSERT_TRUE(std::equal(std::begin(textOps), std::end(textOps), std::begin(expected), std::end(expected), equalOps));
+
+  std::string path = testing::TempDir() + "tree-io-test.bin";
+  OpReader convertReader{text};
+  writeBinary(path, convertReader);
+
+  auto binary = InputData::mapFile(path);
+  OpReader binaryReader{binary.view()};
+  ASSERT_TRUE(binaryReader.isBinary());
+  auto binaryOps = readAll(binaryReader);
+  ASSERT_TRUE(
+    std::equal(std::begin(binaryOps), std::end(binaryOps), std::begin(expected), std::end(expected), equalOps));
+  std::remove(path.c_str());
+
+  OpReader broken{"3\n1 2"};
+  Op op{};
+  ASSERT_TRUE(broken.next(op));
+  ASSERT_TRUE(broken.next(op));
+  ASSERT_THROW(broken.next(op), std::runtime_error);
+
+  OpReader outOfInt{"2\n2147483647 2147483648"};
+  ASSERT_TRUE(outOfInt.next(op));
+  ASSERT_EQ(op.key_, std::numeric_limits<int>::max());
+  ASSERT_THROW(outOfInt.next(op), std::runtime_error);
+
+  OpReader overflowed{"1\n18446744073709551617"};
+  ASSERT_THROW(overflowed.next(op), std::runtime_error);
+
+  OpReader truncatedSign{"2\n5 -"};
+  ASSERT_TRUE(truncatedSign.next(op));
+  ASSERT_THROW(truncatedSign.next(op), std::runtime_error);
+
+  ASSERT_THROW(OpReader{"-"}, std::runtime_error);
+}
+
+} // namespace tree::io
@@ -4,102 +4,255 @@
 namespace tree
 {
 
+namespace
+{
+
+size_t verifyThreadsNum(size_t treeSize)
+{
+  if (treeSize < TreeTester::PARALLEL_VERIFY_SIZE)
+    return 1;
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+} // namespace
+
 bool TreeTester::verify(const TestTree &tree)
 {
-  if (!tree.DFS<StructTester>(StructTester{tree}))
+  return verify(tree, verifyThreadsNum(tree.size()));
+}
+
+bool TreeTester::verify(const TestTree &tree, size_t threadsNum)
+{
+  return StatVerifier<TestTree>{tree}.verify(threadsNum);
+}
+
+bool TreeTester::verify(const CompactTestTree &tree)
+{
+  size_t blackHeight = 0;
+  if (tree.isRed(tree.root_))
     return false;
-  if (!tree.DFS<ColorsTester>(ColorsTester{tree}))
+  if (!verifyCompact(tree, tree.root_, CompactTestTree::NIL, blackHeight))
     return false;
 
+  return tree.getSize(tree.root_) == tree.size();
+}
+
+bool TreeTester::verifyCompact(const CompactTestTree &tree, uint32_t idx, uint32_t parent, size_t &blackHeight)
+{
+  if (idx == CompactTestTree::NIL)
+  {
+    blackHeight = 1;
+    return true;
+  }
+
+  const auto &node = tree.at(idx);
+  if (node.parent_ != parent)
+    return false;
+  if (tree.isRed(idx) && (tree.isRed(node.left_) || tree.isRed(node.right_)))
+    return false;
+  if (node.left_ != CompactTestTree::NIL && !(tree.at(node.left_).data_ < node.data_))
+    return false;
+  if (node.right_ != CompactTestTree::NIL && !(node.data_ < tree.at(node.right_).data_))
+    return false;
+  if (tree.getSize(idx) != tree.getSize(node.left_) + tree.getSize(node.right_) + 1)
+    return false;
+
+  size_t leftHeight = 0;
+  size_t rightHeight = 0;
+  if (!verifyCompact(tree, node.left_, idx, leftHeight) || !verifyCompact(tree, node.right_, idx, rightHeight))
+    return false;
+  if (leftHeight != rightHeight)
+    return false;
+
+  blackHeight = leftHeight + (tree.isRed(idx) ? 0 : 1);
   return true;
 }
 
-bool TreeTester::StructTester::operator()(TestNode *node) const noexcept
+bool TreeTester::verify(const PersistentTestTree &tree)
 {
-  if (node->data_.passToggle(passToggle_))
+  return verifyPersistent(tree.root_);
+}
+
+bool TreeTester::verifyPersistent(const PersistentTestNode *node)
+{
+  if (node == nullptr)
+    return true;
+
+  const PersistentTestNode *left = node->left_;
+  const PersistentTestNode *right = node->right_;
+
+  if (left != nullptr && !(left->data_ < node->data_))
+    return false;
+  if (right != nullptr && !(node->data_ < right->data_))
     return false;
 
-  TestNode *left = node->left_;
-  TestNode *right = node->right_;
+  size_t leftSize = PersistentTestNode::getSize(left);
+  size_t rightSize = PersistentTestNode::getSize(right);
+  if (node->size_ != leftSize + rightSize + 1)
+    return false;
+  if (leftSize + rightSize >= 2 &&
+      (leftSize > PersistentTestTree::DELTA * rightSize || rightSize > PersistentTestTree::DELTA * leftSize))
+    return false;
 
-  if (left != nullptr)
-    if (left->parent_ != node)
-      return false;
+  return verifyPersistent(left) && verifyPersistent(right);
+}
 
-  if (right != nullptr)
-    if (right->parent_ != node)
-      return false;
+bool TreeTester::verify(const SumTestTree &tree)
+{
+  return StatVerifier<SumTestTree>{tree}.verify(verifyThreadsNum(tree.size()));
+}
 
-  return ++passedNum_ <= treeSize_;
+bool TreeTester::verify(const MultisetTestTree &tree)
+{
+  using EntryTree = decltype(tree.tree_);
+  return StatVerifier<EntryTree>{tree.tree_}.verify(verifyThreadsNum(tree.distinct()));
 }
 
-bool TreeTester::SizesTester::operator()(const TestNode *node) const noexcept
+bool TreeTester::verify(const BlockTestTree &tree)
 {
-  const TestNode *l = node->left_;
-  const TestNode *r = node->right_;
-  size_t rSz = node->rightSize_;
-  size_t lSz = node->leftSize_;
+  size_t size = 0;
+  const int *prevMax = nullptr;
 
-  if (!rootPassed_)
+  for (const auto &block : tree.tree_)
   {
-    rootPassed_ = true;
-    if (treeSize_ != lSz + rSz + 1)
+    if (block.size_ == 0 || block.size_ > BlockTestTree::BLOCK_SIZE)
       return false;
-  }
-
-  if (l == nullptr)
-  {
-    if (lSz != 0)
+    if (prevMax != nullptr && !(*prevMax < block.keys_[0]))
       return false;
-  }
-  else
-  {
-    if (lSz != l->rightSize_ + l->leftSize_ + 1)
+    if (!std::is_sorted(block.keys_, block.keys_ + block.size_, std::less_equal<int>{}) ||
+        block.max_ != block.keys_[block.size_ - 1])
       return false;
-  }
-
-  if (r == nullptr)
-  {
-    if (rSz != 0)
+    if (std::any_of(block.keys_ + block.size_, block.keys_ + BlockTestTree::BLOCK_SIZE,
+                    [](int key) { return key != BlockTestTree::PAD; }))
       return false;
+
+    size += block.size_;
+    prevMax = &block.max_;
   }
-  else
+
+  return size == tree.size();
+}
+
+template <class Tree>
+bool TreeTester::StatVerifier<Tree>::verify(size_t threadsNum)
+{
+  const Node *root = tree_.root_;
+  if (root == nullptr)
+    return tree_.size() == 0 && tree_.leftmost_ == nullptr && tree_.rightmost_ == nullptr;
+  if (root->parent_ != nullptr || Node::getColor(root) != Tree::Color::BLACK)
+    return false;
+
+  std::vector<Subtree> results{};
+  if (threadsNum > 1)
   {
-    if (rSz != r->rightSize_ + r->leftSize_ + 1)
+    // About 2-4 sub trees per thread as in StatTree::traverseParallel.
+    splitDepth_ = std::bit_width(threadsNum) + 1;
+    std::vector<const Node *> subtrees{};
+    collect(root, 0, subtrees);
+    results.resize(subtrees.size());
+
+    std::atomic<bool> failed = false;
+    std::atomic<size_t> nextSubtree = 0;
+    auto work = [&] {
+      StatVerifier local{tree_};
+      for (size_t idx = nextSubtree++; idx < subtrees.size(); idx = nextSubtree++)
+      {
+        if (failed.load(std::memory_order_relaxed))
+          return;
+        results[idx] = local.check(subtrees[idx], splitDepth_);
+        if (!results[idx].valid_)
+          failed.store(true, std::memory_order_relaxed);
+      }
+    };
+
+    // Sub trees are taken one by one, so any number of started threads checks all of them.
+    std::vector<std::thread> workers{};
+    workers.reserve(threadsNum - 1);
+    try
+    {
+      for (size_t i = 0; i + 1 < threadsNum; ++i)
+        workers.emplace_back(work);
+    }
+    catch (const std::system_error &)
+    {}
+
+    work();
+    for (auto &worker : workers)
+      worker.join();
+
+    if (failed)
       return false;
+    ready_ = results.data();
   }
 
-  return true;
+  Subtree whole = check(root, 0);
+  return whole.valid_ && whole.size_ == tree_.size() && whole.min_ == tree_.leftmost_ &&
+         whole.max_ == tree_.rightmost_;
 }
 
-bool TreeTester::ColorsTester::operator()(TestNode *node) const
+template <class Tree>
+auto TreeTester::StatVerifier<Tree>::check(const Node *node, size_t depth) -> Subtree
 {
-  if (node == root_ && TestNode::getColor(node) != TestTree::Color::BLACK)
-    return false;
+  static constexpr Subtree INVALID{.valid_ = false};
 
-  if (TestNode::getColor(node) == TestTree::Color::RED && TestNode::getColor(node->parent_) == TestTree::Color::RED)
-    return false;
+  if (node == nullptr)
+    return {};
+  if (depth == splitDepth_)
+    return *ready_++;
+  if (depth > maxDepth_)
+    return INVALID;
 
-  // Black heights check.
-  size_t blackHeight = 0;
-  if (node->left_ == nullptr && node->right_ == nullptr)
-  {
-    while (node != nullptr)
-    {
-      if (TestNode::getColor(node) == TestTree::Color::BLACK)
-        ++blackHeight;
+  // Links are checked before going down, so a looped pointer can't be followed.
+  const Node *left = node->left_;
+  const Node *right = node->right_;
+  if ((left != nullptr && left->parent_ != node) || (right != nullptr && right->parent_ != node))
+    return INVALID;
 
-      auto hIt = blackHeights_.find(node);
-      if (hIt == blackHeights_.end())
-        blackHeights_.emplace(node, blackHeight);
-      else if (hIt->second != blackHeight)
-        return false;
+  bool red = Node::getColor(node) == Tree::Color::RED;
+  if (red && (Node::getColor(left) == Tree::Color::RED || Node::getColor(right) == Tree::Color::RED))
+    return INVALID;
 
-      node = node->parent_;
-    }
+  Subtree leftTree = check(left, depth + 1);
+  if (!leftTree.valid_)
+    return INVALID;
+  Subtree rightTree = check(right, depth + 1);
+  if (!rightTree.valid_)
+    return INVALID;
+
+  // Comparator is called directly, counting Stats are not thread safe.
+  if (leftTree.max_ != nullptr && !tree_.comp_(leftTree.max_->data_, node->data_))
+    return INVALID;
+  if (rightTree.min_ != nullptr && !tree_.comp_(node->data_, rightTree.min_->data_))
+    return INVALID;
+  if (leftTree.blackHeight_ != rightTree.blackHeight_)
+    return INVALID;
+  if (node->leftSize_ != leftTree.size_ || node->rightSize_ != rightTree.size_)
+    return INVALID;
+  if constexpr (Tree::AGGREGATED)
+    if (!(node->aggregate_ == Node::combineAggregate(node)))
+      return INVALID;
+
+  return {
+    .min_ = leftTree.min_ != nullptr ? leftTree.min_ : node,
+    .max_ = rightTree.max_ != nullptr ? rightTree.max_ : node,
+    .size_ = leftTree.size_ + rightTree.size_ + 1,
+    .blackHeight_ = leftTree.blackHeight_ + (red ? 0 : 1),
+  };
+}
+
+template <class Tree>
+void TreeTester::StatVerifier<Tree>::collect(const Node *node, size_t depth, std::vector<const Node *> &subtrees) const
+{
+  if (node == nullptr)
+    return;
+  if (depth == splitDepth_)
+  {
+    subtrees.push_back(node);
+    return;
   }
 
-  return true;
+  collect(node->left_, depth + 1, subtrees);
+  collect(node->right_, depth + 1, subtrees);
 }
 
 } // namespace tree
@@ -1,10 +1,26 @@
 
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <random>
+#include <ranges>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "concurrent-tree.hh"
+#include "multiset-tree.hh"
 #include "tree-tester.hh"
+#include "windowed-quantile.hh"
 
 namespace tree
 {
@@ -16,7 +32,7 @@ constexpr size_t TEST_ERASES_NUM = TEST_INSERTS_NUM / 5;
 
 using testData = std::vector<size_t>;
 
-void shuffle(testData data)
+void shuffle(testData &data)
 {
   static auto rEng = std::default_random_engine{};
   std::shuffle(std::begin(data), std::end(data), rEng);
@@ -30,6 +46,114 @@ testData genShuffled(size_t size)
   return toRet;
 }
 
+// Allocator that counts requests to it.
+template <class T>
+struct CountingAllocator
+{
+  using value_type = T;
+
+  size_t *allocsNum_;
+
+  CountingAllocator(size_t *allocsNum) : allocsNum_{allocsNum}
+  {}
+
+  template <class U>
+  CountingAllocator(const CountingAllocator<U> &sd) : allocsNum_{sd.allocsNum_}
+  {}
+
+  T *allocate(size_t n)
+  {
+    ++*allocsNum_;
+    return std::allocator<T>{}.allocate(n);
+  }
+
+  void deallocate(T *ptr, size_t n)
+  {
+    std::allocator<T>{}.deallocate(ptr, n);
+  }
+
+  bool operator==(const CountingAllocator &) const = default;
+};
+
+// Composite record ordered by id only.
+struct Record
+{
+  size_t id_ = 0;
+  std::string payload_{};
+};
+
+struct RecordLess
+{
+  using is_transparent = void;
+
+  bool operator()(const Record &lhs, const Record &rhs) const noexcept
+  {
+    return lhs.id_ < rhs.id_;
+  }
+  bool operator()(const Record &lhs, size_t rhs) const noexcept
+  {
+    return lhs.id_ < rhs;
+  }
+  bool operator()(size_t lhs, const Record &rhs) const noexcept
+  {
+    return lhs < rhs.id_;
+  }
+};
+
+// Descending order to check that Compare is used everywhere.
+struct Greater
+{
+  bool operator()(size_t lhs, size_t rhs) const noexcept
+  {
+    return lhs > rhs;
+  }
+};
+
+// Value that counts its live instances.
+struct Counted
+{
+  static inline size_t liveNum_ = 0;
+  size_t value_ = 0;
+
+  Counted(size_t value) : value_{value}
+  {
+    ++liveNum_;
+  }
+  Counted(size_t first, size_t second) : value_{first * second}
+  {
+    ++liveNum_;
+  }
+  Counted(const Counted &sd) : value_{sd.value_}
+  {
+    ++liveNum_;
+  }
+  ~Counted()
+  {
+    --liveNum_;
+  }
+
+  std::strong_ordering operator<=>(const Counted &) const = default;
+};
+
+std::vector<size_t> genRandom(size_t size, size_t maxValue)
+{
+  static auto rEng = std::default_random_engine{};
+  std::uniform_int_distribution<size_t> values{0, maxValue};
+
+  std::vector<size_t> toRet(size);
+  std::generate(std::begin(toRet), std::end(toRet), [&] { return values(rEng); });
+  return toRet;
+}
+
+template <class Tree>
+std::vector<size_t> getValues(const Tree &tree)
+{
+  std::vector<size_t> values{};
+  for (const auto &data : tree)
+    values.push_back(data.value_);
+  return values;
+}
+
 } // namespace
 
 TEST(StatTreeTests, InsertTest)
@@ -43,7 +167,7 @@ TEST(StatTreeTests, InsertTest)
   for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
     ASSERT_FALSE(tree.find(toInsert[i]) == tree.end());
 
-  ASSERT_FALSE(TreeTester::verify(tree));
+  ASSERT_TRUE(TreeTester::verify(tree));
 }
 
 TEST(StatTreeTests, DeleteTest)
@@ -65,7 +189,1191 @@ TEST(StatTreeTests, DeleteTest)
   for (size_t i = TEST_ERASES_NUM; i < TEST_INSERTS_NUM; ++i)
     ASSERT_FALSE(tree.find(toErase[i]) == tree.end());
 
-  ASSERT_FALSE(TreeTester::verify(tree));
+  ASSERT_TRUE(TreeTester::verify(tree));
+}
+
+TEST(StatTreeTests, EraseRightChildrenTest)
+{
+  std::vector<size_t> toInsert(TEST_INSERTS_NUM);
+  std::iota(std::begin(toInsert), std::end(toInsert), 0);
+  std::shuffle(std::begin(toInsert), std::end(toInsert), std::default_random_engine{});
+
+  TreeTester::TestTree tree{};
+  for (auto value : toInsert)
+    tree.insert(value);
+
+  // Erasing from the greatest makes the fixup go through mirrored cases.
+  for (size_t value = TEST_INSERTS_NUM - 1; value >= TEST_INSERTS_NUM / 2; --value)
+    tree.erase(tree.find(value));
+
+  for (size_t value = 0; value < TEST_INSERTS_NUM / 2; ++value)
+    ASSERT_FALSE(tree.find(value) == tree.end());
+  ASSERT_EQ(tree.size(), TEST_INSERTS_NUM / 2);
+  ASSERT_TRUE(TreeTester::verify(tree));
+}
+
+TEST(StatTreeTests, RankSelectTest)
+{
+  auto toInsert = genShuffled(TEST_INSERTS_NUM);
+
+  TreeTester::TestTree tree{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    tree.insert(toInsert[i] * 2);
+
+  auto toErase = genShuffled(TEST_INSERTS_NUM);
+  for (size_t i = 0; i < TEST_ERASES_NUM; ++i)
+    tree.erase(tree.find(toErase[i] * 2));
+
+  ASSERT_TRUE(TreeTester::verify(tree));
+  ASSERT_EQ(tree.size(), TEST_INSERTS_NUM - TEST_ERASES_NUM);
+
+  // Sorted reference of the remaining values.
+  std::vector<size_t> left{std::begin(toErase) + TEST_ERASES_NUM, std::end(toErase)};
+  std::sort(std::begin(left), std::end(left));
+
+  for (size_t k = 0; k < left.size(); ++k)
+  {
+    ASSERT_EQ((*tree.select(k)).value_, left[k] * 2);
+    ASSERT_EQ(tree.rank(left[k] * 2), k);
+    ASSERT_EQ(tree.rank(left[k] * 2 + 1), k + 1);
+    ASSERT_EQ(tree.lesserOfOrderK(k + 1).value_, left[k] * 2);
+  }
+  ASSERT_TRUE(tree.select(left.size()) == tree.end());
+
+  auto lo = left[left.size() / 4] * 2;
+  auto hi = left[left.size() / 2] * 2;
+  ASSERT_EQ(tree.countInRange(lo, hi), left.size() / 2 - left.size() / 4 + 1);
+  ASSERT_EQ(tree.countInRange(lo + 1, hi - 1), left.size() / 2 - left.size() / 4 - 1);
+  ASSERT_EQ(tree.countInRange(hi, lo), 0);
+}
+
+TEST(StatTreeTests, PoolTest)
+{
+  size_t allocsNum = 0;
+  CountingAllocator<size_t> alloc{&allocsNum};
+  StatTree<size_t, std::less<size_t>, CountingAllocator<size_t>> tree{alloc};
+
+  tree.reserve(TEST_INSERTS_NUM);
+  ASSERT_EQ(allocsNum, 1);
+
+  auto toInsert = genShuffled(TEST_INSERTS_NUM);
+  for (size_t round = 0; round < 10; ++round)
+  {
+    for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+      tree.insert(toInsert[i]);
+    for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+      tree.erase(tree.find(toInsert[i]));
+  }
+
+  // Erased nodes are recycled, so reserved memory is enough.
+  ASSERT_EQ(allocsNum, 1);
+  ASSERT_EQ(tree.size(), 0);
+}
+
+TEST(StatTreeTests, AssignSortedTest)
+{
+  for (size_t size = 0; size < 100; ++size)
+  {
+    std::vector<size_t> sorted(size);
+    std::iota(std::begin(sorted), std::end(sorted), 0);
+
+    TreeTester::TestTree tree{std::begin(sorted), std::end(sorted)};
+    ASSERT_EQ(tree.size(), size);
+    ASSERT_TRUE(TreeTester::verify(tree));
+
+    for (size_t k = 0; k < size; ++k)
+      ASSERT_EQ((*tree.select(k)).value_, k);
+  }
+
+  // Sorted range with equal keys is not bulk loaded as is, keys stay unique.
+  std::vector<size_t> withEqual{1, 2, 2, 3, 3, 3};
+  TreeTester::TestTree unique{std::begin(withEqual), std::end(withEqual)};
+  ASSERT_EQ(unique.size(), 3);
+  ASSERT_EQ(unique.countInRange(2, 2), 1);
+  ASSERT_TRUE(TreeTester::verify(unique));
+
+  // Sizes large enough for parallel linking.
+  std::vector<size_t> sorted(TEST_INSERTS_NUM * 100);
+  std::iota(std::begin(sorted), std::end(sorted), 0);
+
+  TreeTester::TestTree tree{};
+  tree.assignSorted(std::begin(sorted), std::end(sorted), 4);
+  ASSERT_EQ(tree.size(), sorted.size());
+  ASSERT_TRUE(TreeTester::verify(tree));
+
+  for (size_t k = 0; k < sorted.size(); k += 997)
+    ASSERT_EQ(tree.rank(sorted[k]), k);
+
+  // Tree is still usable after bulk load.
+  auto toErase = genShuffled(TEST_INSERTS_NUM);
+  for (size_t i = 0; i < TEST_ERASES_NUM; ++i)
+    tree.erase(tree.find(toErase[i]));
+  ASSERT_TRUE(TreeTester::verify(tree));
+}
+
+TEST(StatTreeTests, CompareTest)
+{
+  auto toInsert = genShuffled(TEST_INSERTS_NUM);
+
+  StatTree<size_t, Greater> tree{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    tree.insert(toInsert[i]);
+
+  for (size_t k = 0; k < TEST_INSERTS_NUM; ++k)
+  {
+    ASSERT_EQ(*tree.select(k), TEST_INSERTS_NUM - 1 - k);
+    ASSERT_EQ(tree.rank(k), TEST_INSERTS_NUM - 1 - k);
+    ASSERT_FALSE(tree.find(k) == tree.end());
+  }
+  ASSERT_TRUE(tree.find(TEST_INSERTS_NUM) == tree.end());
+  ASSERT_EQ(tree.countInRange(20, 10), 11);
+}
+
+TEST(StatTreeTests, TransparentLookupTest)
+{
+  auto toInsert = genShuffled(TEST_INSERTS_NUM);
+
+  StatTree<Record, RecordLess> tree{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    tree.insert(Record{toInsert[i] * 2, std::to_string(toInsert[i])});
+
+  for (size_t id = 0; id < TEST_INSERTS_NUM; ++id)
+  {
+    auto found = tree.find(id * 2);
+    ASSERT_FALSE(found == tree.end());
+    ASSERT_EQ((*found).payload_, std::to_string(id));
+
+    ASSERT_TRUE(tree.find(id * 2 + 1) == tree.end());
+    if (id + 1 < TEST_INSERTS_NUM)
+    {
+      ASSERT_EQ((*tree.lower_bound(id * 2 + 1)).id_, id * 2 + 2);
+    }
+    ASSERT_EQ(tree.rank(id * 2 + 1), id + 1);
+  }
+  ASSERT_TRUE(tree.lower_bound(TEST_INSERTS_NUM * 2) == tree.end());
+  ASSERT_EQ(tree.countInRange(size_t{10}, size_t{20}), 6);
+}
+
+TEST(StatTreeTests, IteratorTest)
+{
+  static_assert(std::bidirectional_iterator<TreeTester::TestTree::Iterator>);
+
+  auto toInsert = genShuffled(TEST_INSERTS_NUM);
+
+  TreeTester::TestTree tree{};
+  ASSERT_TRUE(tree.begin() == tree.end());
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    tree.insert(toInsert[i] * 2);
+
+  size_t expected = 0;
+  for (const auto &data : tree)
+  {
+    ASSERT_EQ(data.value_, expected);
+    expected += 2;
+  }
+  ASSERT_EQ(expected, TEST_INSERTS_NUM * 2);
+
+  for (auto it = tree.rbegin(); it != tree.rend(); ++it)
+  {
+    expected -= 2;
+    ASSERT_EQ(it->value_, expected);
+  }
+
+  // Cached bounds are kept on erasing.
+  auto end = tree.end();
+  tree.erase(tree.begin());
+  tree.erase(std::prev(tree.end()));
+  ASSERT_EQ(tree.begin()->value_, 2);
+  ASSERT_EQ(std::prev(end)->value_, TEST_INSERTS_NUM * 2 - 4);
+  ASSERT_EQ(std::distance(tree.begin(), tree.end()), TEST_INSERTS_NUM - 2);
+
+  ASSERT_EQ(tree.upper_bound(10)->value_, 12);
+  ASSERT_EQ(tree.upper_bound(11)->value_, 12);
+  ASSERT_TRUE(tree.upper_bound(TEST_INSERTS_NUM * 2) == tree.end());
+
+  auto [first, last] = tree.equal_range(10);
+  ASSERT_EQ(std::distance(first, last), 1);
+  ASSERT_EQ(first->value_, 10);
+
+  auto [none, noneEnd] = tree.equal_range(11);
+  ASSERT_TRUE(none == noneEnd);
+}
+
+TEST(StatTreeTests, LifetimeTest)
+{
+  auto toInsert = genShuffled(TEST_INSERTS_NUM);
+  {
+    StatTree<Counted> tree{};
+    for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+      ASSERT_TRUE(tree.insert(Counted{toInsert[i]}).second);
+    ASSERT_EQ(Counted::liveNum_, TEST_INSERTS_NUM);
+
+    // Equal keys are not inserted.
+    auto [it, inserted] = tree.insert(Counted{toInsert[0]});
+    ASSERT_FALSE(inserted);
+    ASSERT_EQ(it->value_, toInsert[0]);
+    ASSERT_FALSE(tree.emplace(toInsert[1], 1).second);
+    ASSERT_TRUE(tree.emplace(TEST_INSERTS_NUM, 2).second);
+    ASSERT_EQ(tree.size(), TEST_INSERTS_NUM + 1);
+    ASSERT_EQ(Counted::liveNum_, TEST_INSERTS_NUM + 1);
+
+    StatTree<Counted> copy{tree};
+    ASSERT_EQ(Counted::liveNum_, 2 * (TEST_INSERTS_NUM + 1));
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), copy.begin(), copy.end()));
+    ASSERT_EQ(copy.rank(Counted{TEST_INSERTS_NUM / 2}), TEST_INSERTS_NUM / 2);
+
+    StatTree<Counted> moved{std::move(copy)};
+    ASSERT_EQ(copy.size(), 0);
+    ASSERT_TRUE(copy.begin() == copy.end());
+    ASSERT_EQ(moved.size(), TEST_INSERTS_NUM + 1);
+
+    copy = moved;
+    tree = std::move(moved);
+    ASSERT_EQ(Counted::liveNum_, 2 * (TEST_INSERTS_NUM + 1));
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), copy.begin(), copy.end()));
+  }
+  ASSERT_EQ(Counted::liveNum_, 0);
+
+  // Copied tree keeps all invariants.
+  TreeTester::TestTree tree{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    tree.insert(toInsert[i]);
+  TreeTester::TestTree copy{tree};
+  ASSERT_TRUE(TreeTester::verify(copy));
+}
+
+TEST(StatTreeTests, CompactTreeTest)
+{
+  auto toInsert = genShuffled(TEST_INSERTS_NUM);
+
+  TreeTester::CompactTestTree tree{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    ASSERT_TRUE(tree.insert(toInsert[i] * 2).second);
+  ASSERT_FALSE(tree.insert(toInsert[0] * 2).second);
+  ASSERT_TRUE(TreeTester::verify(tree));
+
+  auto toErase = genShuffled(TEST_INSERTS_NUM);
+  for (size_t i = 0; i < TEST_ERASES_NUM; ++i)
+    tree.erase(tree.find(toErase[i] * 2));
+  ASSERT_TRUE(TreeTester::verify(tree));
+  ASSERT_EQ(tree.size(), TEST_INSERTS_NUM - TEST_ERASES_NUM);
+
+  // Erased nodes are reused.
+  for (size_t i = 0; i < TEST_ERASES_NUM; ++i)
+    tree.insert(toErase[i] * 2 + 1);
+  ASSERT_TRUE(TreeTester::verify(tree));
+
+  std::vector<size_t> expected{};
+  for (size_t i = TEST_ERASES_NUM; i < TEST_INSERTS_NUM; ++i)
+    expected.push_back(toErase[i] * 2);
+  for (size_t i = 0; i < TEST_ERASES_NUM; ++i)
+    expected.push_back(toErase[i] * 2 + 1);
+  std::sort(std::begin(expected), std::end(expected));
+
+  ASSERT_TRUE(std::equal(tree.begin(), tree.end(), std::begin(expected), std::end(expected)));
+  for (size_t k = 0; k < expected.size(); ++k)
+  {
+    ASSERT_EQ(*tree.select(k), expected[k]);
+    ASSERT_EQ(tree.rank(expected[k]), k);
+  }
+  ASSERT_EQ(*std::prev(tree.end()), expected.back());
+}
+
+TEST(StatTreeTests, BatchTest)
+{
+  auto rEng = std::default_random_engine{};
+  std::uniform_int_distribution<size_t> keys{0, TEST_INSERTS_NUM * 4};
+
+  TreeTester::TestTree tree{};
+  std::set<size_t> reference{};
+
+  // Batch sizes cover both finger and rebuild paths.
+  for (size_t batchSize : {TEST_INSERTS_NUM, TEST_INSERTS_NUM / 20, size_t{1}, TEST_INSERTS_NUM / 2, size_t{7}})
+  {
+    std::vector<size_t> toInsert(batchSize);
+    std::vector<size_t> toErase(batchSize / 2);
+    std::generate(std::begin(toInsert), std::end(toInsert), [&] { return keys(rEng); });
+    std::generate(std::begin(toErase), std::end(toErase), [&] { return keys(rEng); });
+
+    size_t inserted = tree.insertBatch(toInsert);
+    size_t oldSize = reference.size();
+    reference.insert(std::begin(toInsert), std::end(toInsert));
+    ASSERT_EQ(inserted, reference.size() - oldSize);
+    ASSERT_TRUE(TreeTester::verify(tree));
+
+    size_t erased = tree.eraseBatch(toErase);
+    oldSize = reference.size();
+    for (auto key : toErase)
+      reference.erase(key);
+    ASSERT_EQ(erased, oldSize - reference.size());
+    ASSERT_TRUE(TreeTester::verify(tree));
+
+    ASSERT_EQ(tree.size(), reference.size());
+    ASSERT_TRUE(std::equal(std::begin(tree), std::end(tree), std::begin(reference), std::end(reference),
+                           [](const auto &data, size_t value) { return data.value_ == value; }));
+  }
+
+  // Small batches are applied key by key, nodes of other elements stay in place.
+  TreeTester::TestTree small{};
+  small.insertBatch(std::vector<size_t>{1, 2, 3});
+  auto kept = small.find(3);
+  const auto *keptData = &*kept;
+  ASSERT_EQ(small.eraseBatch(std::vector<size_t>{1}), 1);
+  ASSERT_EQ(small.insertBatch(std::vector<size_t>{0, 4}), 2);
+  ASSERT_EQ(&*kept, keptData);
+  ASSERT_EQ(kept, small.find(3));
+  ASSERT_EQ(small.rank(3), 2);
+}
+
+TEST(StatTreeTests, HintedInsertTest)
+{
+  auto rEng = std::default_random_engine{};
+
+  // Almost sorted keys: sorted ones with small jitter.
+  std::vector<size_t> almostSorted(TEST_INSERTS_NUM * 4);
+  std::iota(std::begin(almostSorted), std::end(almostSorted), 0);
+  for (size_t i = 0; i + 1 < almostSorted.size(); i += 2 + rEng() % 3)
+    std::swap(almostSorted[i], almostSorted[i + 1]);
+
+  TreeTester::TestTree appended{};
+  TreeTester::TestTree fingered{};
+  auto finger = fingered.end();
+  for (auto key : almostSorted)
+  {
+    ASSERT_EQ(appended.insert(appended.end(), key)->value_, key);
+    finger = fingered.insert(finger, key);
+    ASSERT_EQ(finger->value_, key);
+  }
+  ASSERT_TRUE(TreeTester::verify(appended));
+  ASSERT_TRUE(TreeTester::verify(fingered));
+  ASSERT_EQ(getValues(appended), getValues(fingered));
+  ASSERT_TRUE(std::ranges::equal(getValues(appended), std::views::iota(size_t{0}, almostSorted.size())));
+
+  // Any hint gives the same result, equal keys are found.
+  TreeTester::TestTree tree{};
+  std::set<size_t> reference{};
+  for (auto key : genRandom(TEST_INSERTS_NUM, TEST_INSERTS_NUM))
+  {
+    auto hint = tree.select(rEng() % (tree.size() + 1));
+    auto it = rEng() % 2 == 0 ? tree.insert(hint, key) : tree.emplace_hint(hint, key);
+    ASSERT_EQ(it->value_, key);
+    reference.insert(key);
+  }
+  ASSERT_TRUE(TreeTester::verify(tree));
+  ASSERT_TRUE(std::ranges::equal(getValues(tree), reference));
+
+  // Appends compare with the rightmost element only.
+  using CountedTree = StatTree<size_t, std::less<size_t>, std::allocator<size_t>, NoAggregate, CountingStats>;
+  CountedTree counted{};
+  for (size_t key = 0; key < TEST_INSERTS_NUM; ++key)
+    counted.insert(counted.end(), key);
+  ASSERT_EQ(counted.stats().comparisons_, TEST_INSERTS_NUM - 1);
+  ASSERT_EQ(counted.stats().descentDepths_[0], TEST_INSERTS_NUM);
+}
+
+TEST(StatTreeTests, SplitJoinTest)
+{
+  auto toInsert = genShuffled(TEST_INSERTS_NUM);
+
+  for (size_t splitKey : {size_t{0}, TEST_INSERTS_NUM / 3, TEST_INSERTS_NUM - 1, TEST_INSERTS_NUM * 2})
+  {
+    TreeTester::TestTree tree{};
+    for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+      tree.insert(toInsert[i]);
+
+    auto [left, right] = tree.split(splitKey);
+    ASSERT_TRUE(tree.empty());
+    ASSERT_TRUE(TreeTester::verify(left));
+    ASSERT_TRUE(TreeTester::verify(right));
+    ASSERT_EQ(left.size(), std::min(splitKey, TEST_INSERTS_NUM));
+    ASSERT_EQ(left.size() + right.size(), TEST_INSERTS_NUM);
+    // Rejoining by the first right element.
+    if (right.empty())
+      continue;
+    ASSERT_EQ(right.begin()->value_, splitKey);
+    size_t pivot = right.begin()->value_;
+    right.erase(right.begin());
+
+    auto joined = TreeTester::TestTree::join(std::move(left), pivot, std::move(right));
+    ASSERT_TRUE(TreeTester::verify(joined));
+    ASSERT_EQ(joined.size(), TEST_INSERTS_NUM);
+    for (size_t k = 0; k < TEST_INSERTS_NUM; ++k)
+      ASSERT_EQ(joined.select(k)->value_, k);
+  }
+
+  // Trees of much different heights.
+  TreeTester::TestTree small{};
+  small.insert(TEST_INSERTS_NUM * 2);
+  TreeTester::TestTree big{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    big.insert(toInsert[i]);
+
+  auto joined = TreeTester::TestTree::join(std::move(big), std::move(small));
+  ASSERT_TRUE(TreeTester::verify(joined));
+  ASSERT_EQ(joined.size(), TEST_INSERTS_NUM + 1);
+  ASSERT_EQ(std::prev(joined.end())->value_, TEST_INSERTS_NUM * 2);
+}
+
+TEST(StatTreeTests, SetOperationsTest)
+{
+  using TestTree = TreeTester::TestTree;
+
+  for (size_t lhsSize : {size_t{0}, size_t{10}, TEST_INSERTS_NUM})
+  {
+    auto lhsValues = genRandom(lhsSize, TEST_INSERTS_NUM);
+    auto rhsValues = genRandom(TEST_INSERTS_NUM / 2, TEST_INSERTS_NUM);
+    std::set<size_t> lhsSet{std::begin(lhsValues), std::end(lhsValues)};
+    std::set<size_t> rhsSet{std::begin(rhsValues), std::end(rhsValues)};
+
+    auto makeTrees = [&] {
+      std::pair<TestTree, TestTree> trees{};
+      for (auto value : lhsValues)
+        trees.first.insert(value);
+      for (auto value : rhsValues)
+        trees.second.insert(value);
+      return trees;
+    };
+
+    std::vector<size_t> expected{};
+    auto [lhs, rhs] = makeTrees();
+    auto united = TestTree::setUnion(std::move(lhs), std::move(rhs));
+    std::set_union(std::begin(lhsSet), std::end(lhsSet), std::begin(rhsSet), std::end(rhsSet),
+                   std::back_inserter(expected));
+    ASSERT_TRUE(TreeTester::verify(united));
+    ASSERT_EQ(getValues(united), expected);
+
+    expected.clear();
+    std::tie(lhs, rhs) = makeTrees();
+    auto intersected = TestTree::setIntersection(std::move(lhs), std::move(rhs));
+    std::set_intersection(std::begin(lhsSet), std::end(lhsSet), std::begin(rhsSet), std::end(rhsSet),
+                          std::back_inserter(expected));
+    ASSERT_TRUE(TreeTester::verify(intersected));
+    ASSERT_EQ(getValues(intersected), expected);
+
+    expected.clear();
+    std::tie(lhs, rhs) = makeTrees();
+    auto subtracted = TestTree::setDifference(std::move(lhs), std::move(rhs));
+    std::set_difference(std::begin(lhsSet), std::end(lhsSet), std::begin(rhsSet), std::end(rhsSet),
+                        std::back_inserter(expected));
+    ASSERT_TRUE(TreeTester::verify(subtracted));
+    ASSERT_EQ(getValues(subtracted), expected);
+
+    // Results keep working with nodes came from the other tree.
+    for (auto value : rhsValues)
+      united.erase(united.find(value));
+    ASSERT_TRUE(TreeTester::verify(united));
+  }
+}
+
+TEST(StatTreeTests, AggregateTest)
+{
+  using TestTree = TreeTester::SumTestTree;
+
+  TestTree tree{};
+  std::set<size_t> expected{};
+
+  auto checkAggregates = [&](const TestTree &checked) {
+    ASSERT_TRUE(TreeTester::verify(checked));
+    ASSERT_EQ(checked.aggregate(), std::accumulate(std::begin(expected), std::end(expected), size_t{0}));
+
+    for (size_t lo = 0; lo < TEST_INSERTS_NUM; lo += TEST_INSERTS_NUM / 10)
+      for (size_t hi = lo / 2; hi < TEST_INSERTS_NUM; hi += TEST_INSERTS_NUM / 7)
+      {
+        size_t sum = 0;
+        for (auto it = expected.lower_bound(lo); it != std::end(expected) && *it <= hi; ++it)
+          sum += *it;
+        ASSERT_EQ(checked.aggregate(lo, hi), sum);
+      }
+
+    // Prefix sums are strictly increasing except for zero.
+    size_t prefix = 0;
+    for (auto value : expected)
+    {
+      prefix += value;
+      if (value != 0)
+      {
+        ASSERT_EQ(*checked.selectByAggregate(prefix), value);
+      }
+    }
+    ASSERT_EQ(checked.selectByAggregate(prefix + 1), checked.end());
+  };
+
+  auto values = genRandom(TEST_INSERTS_NUM * 2, TEST_INSERTS_NUM);
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    if (i % 3 == 2)
+      ASSERT_EQ(tree.erase(values[i]), expected.erase(values[i]));
+    else
+      ASSERT_EQ(tree.insert(values[i]).second, expected.insert(values[i]).second);
+  }
+  checkAggregates(tree);
+
+  auto toErase = genRandom(TEST_ERASES_NUM, TEST_INSERTS_NUM);
+  tree.eraseBatch(toErase);
+  for (auto value : toErase)
+    expected.erase(value);
+  checkAggregates(tree);
+
+  auto [left, right] = tree.split(TEST_INSERTS_NUM / 2);
+  ASSERT_TRUE(TreeTester::verify(left));
+  ASSERT_TRUE(TreeTester::verify(right));
+  ASSERT_EQ(left.aggregate() + right.aggregate(), std::accumulate(std::begin(expected), std::end(expected), size_t{0}));
+  checkAggregates(TestTree::join(std::move(left), std::move(right)));
+
+  TestTree loaded{std::begin(expected), std::end(expected)};
+  checkAggregates(loaded);
+  checkAggregates(TestTree{loaded});
+
+  // Max of weights of the records.
+  struct Record
+  {
+    size_t key_;
+    int weight_;
+
+    bool operator<(const Record &sd) const noexcept
+    {
+      return key_ < sd.key_;
+    }
+  };
+  struct Weight
+  {
+    int operator()(const Record &record) const noexcept
+    {
+      return record.weight_;
+    }
+  };
+
+  StatTree<Record, std::less<Record>, std::allocator<Record>, MaxAggregate<Record, Weight>> records{};
+  ASSERT_EQ(records.aggregate(), std::numeric_limits<int>::lowest());
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    records.insert(Record{i, static_cast<int>(i % 100)});
+  ASSERT_EQ(records.aggregate(), 99);
+  ASSERT_EQ(records.aggregate(Record{150, 0}, Record{180, 0}), 80);
+  ASSERT_EQ(records.aggregate(Record{180, 0}, Record{150, 0}), std::numeric_limits<int>::lowest());
+  ASSERT_EQ(records.findPrefix([](int max) { return max >= 42; })->key_, 42);
+}
+
+TEST(StatTreeTests, WindowedQuantileTest)
+{
+  constexpr size_t WINDOW = 100;
+  const std::vector<double> qs{0, 0.1, 0.5, 0.5, 0.9, 0.99, 1, 0.25};
+
+  WindowedQuantile<size_t> quantiles{WINDOW};
+  ASSERT_THROW(quantiles.median(), std::out_of_range);
+
+  // Few distinct values, so the window has a lot of duplicates.
+  auto samples = genRandom(TEST_INSERTS_NUM * 5, TEST_INSERTS_NUM / 20);
+  for (size_t i = 0; i < samples.size(); ++i)
+  {
+    quantiles.push(samples[i]);
+
+    std::vector<size_t> window(std::begin(samples) + static_cast<std::ptrdiff_t>(i + 1 - std::min(i + 1, WINDOW)),
+                               std::begin(samples) + static_cast<std::ptrdiff_t>(i + 1));
+    std::sort(std::begin(window), std::end(window));
+    ASSERT_EQ(quantiles.size(), window.size());
+
+    std::vector<size_t> expected{};
+    for (double q : qs)
+    {
+      auto rank = static_cast<size_t>(std::ceil(q * static_cast<double>(window.size())));
+      expected.push_back(window[std::max<size_t>(rank, 1) - 1]);
+    }
+
+    std::vector<size_t> found{};
+    quantiles.quantiles(qs, std::back_inserter(found));
+    ASSERT_EQ(found, expected);
+    ASSERT_EQ(quantiles.median(), expected[2]);
+    ASSERT_EQ(quantiles.kth(window.size() - 1), window.back());
+  }
+
+  ASSERT_THROW(quantiles.quantile(1.5), std::out_of_range);
+  quantiles.clear();
+  ASSERT_TRUE(quantiles.empty());
+  quantiles.push(42);
+  ASSERT_EQ(quantiles.median(), 42);
+}
+
+TEST(StatTreeTests, MultisetTest)
+{
+  StatMultiset<size_t> tree{};
+  std::multiset<size_t> expected{};
+
+  // Few distinct values with a lot of copies.
+  auto values = genRandom(TEST_INSERTS_NUM * 5, TEST_INSERTS_NUM / 10);
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    if (i % 5 == 3)
+    {
+      auto it = expected.find(values[i]);
+      ASSERT_EQ(tree.eraseOne(values[i]), it == std::end(expected) ? 0 : 1);
+      if (it != std::end(expected))
+        expected.erase(it);
+    }
+    else if (i % 50 == 49)
+      ASSERT_EQ(tree.erase(values[i]), expected.erase(values[i]));
+    else
+    {
+      tree.insert(values[i]);
+      expected.insert(values[i]);
+    }
+  }
+
+  ASSERT_EQ(tree.size(), expected.size());
+  std::set<size_t> distinct{std::begin(expected), std::end(expected)};
+  ASSERT_EQ(tree.distinct(), distinct.size());
+
+  for (size_t value = 0; value <= TEST_INSERTS_NUM / 10 + 1; ++value)
+  {
+    ASSERT_EQ(tree.count(value), expected.count(value));
+    ASSERT_EQ(tree.rank(value), std::distance(std::begin(expected), expected.lower_bound(value)));
+    ASSERT_EQ(tree.countInRange(value, value + 10),
+              std::distance(expected.lower_bound(value), expected.upper_bound(value + 10)));
+  }
+
+  size_t k = 0;
+  for (auto value : expected)
+    ASSERT_EQ(tree.select(k++)->data_, value);
+  ASSERT_EQ(tree.select(k), tree.end());
+
+  auto it = std::begin(expected);
+  for (const auto &entry : tree)
+  {
+    ASSERT_EQ(entry.data_, *it);
+    ASSERT_EQ(entry.count_, expected.count(*it));
+    std::advance(it, entry.count_);
+  }
+
+  tree.insert(TEST_INSERTS_NUM, 1000);
+  ASSERT_EQ(tree.count(TEST_INSERTS_NUM), 1000);
+  ASSERT_EQ(tree.size(), expected.size() + 1000);
+  ASSERT_EQ(tree.erase(TEST_INSERTS_NUM), 1000);
+  ASSERT_EQ(tree.size(), expected.size());
+}
+
+TEST(StatTreeTests, BlockTreeTest)
+{
+  static_assert(std::is_same_v<FastStatTree<int>, BlockStatTree<int>>);
+  static_assert(std::is_same_v<FastStatTree<std::string>, StatTree<std::string>>);
+  static_assert(std::is_same_v<FastStatTree<int, std::greater<int>>, StatTree<int, std::greater<int>>>);
+
+  using TestTree = TreeTester::BlockTestTree;
+
+  TestTree tree{};
+  std::set<int> expected{};
+
+  // Erases win at the end, so blocks are split and merged.
+  auto values = genRandom(TEST_INSERTS_NUM * 20, TEST_INSERTS_NUM * 5);
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    int value = static_cast<int>(values[i]);
+    if (i % 3 == 2 || (i > values.size() / 2 && i % 3 == 1))
+      ASSERT_EQ(tree.erase(value), expected.erase(value));
+    else
+      ASSERT_EQ(tree.insert(value).second, expected.insert(value).second);
+
+    if (i % 1000 == 0)
+    {
+      ASSERT_TRUE(TreeTester::verify(tree));
+    }
+  }
+  ASSERT_TRUE(TreeTester::verify(tree));
+  ASSERT_EQ(tree.size(), expected.size());
+  ASSERT_TRUE(std::equal(tree.begin(), tree.end(), std::begin(expected), std::end(expected)));
+  ASSERT_TRUE(std::equal(std::make_reverse_iterator(tree.end()), std::make_reverse_iterator(tree.begin()),
+                         std::rbegin(expected), std::rend(expected)));
+
+  for (int value = -1; value <= static_cast<int>(TEST_INSERTS_NUM * 5) + 1; ++value)
+  {
+    auto it = expected.lower_bound(value);
+    ASSERT_EQ(tree.rank(value), std::distance(std::begin(expected), it));
+    ASSERT_EQ(tree.find(value) != tree.end(), expected.contains(value));
+    ASSERT_EQ(tree.lower_bound(value) == tree.end(), it == std::end(expected));
+    ASSERT_TRUE(it == std::end(expected) || *tree.lower_bound(value) == *it);
+    ASSERT_EQ(tree.countInRange(value, value + 100),
+              std::distance(it, expected.upper_bound(value + 100)));
+  }
+
+  size_t k = 0;
+  for (auto value : expected)
+    ASSERT_EQ(*tree.select(k++), value);
+  ASSERT_EQ(tree.select(k), tree.end());
+
+  // Extreme keys are not confused with free slots.
+  BlockStatTree<int64_t> extremes{};
+  for (int64_t key : {std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), int64_t{0}})
+    extremes.insert(key);
+  ASSERT_EQ(extremes.rank(std::numeric_limits<int64_t>::max()), 2);
+  ASSERT_EQ(*extremes.select(2), std::numeric_limits<int64_t>::max());
+  ASSERT_EQ(extremes.erase(std::numeric_limits<int64_t>::max()), 1);
+  ASSERT_EQ(extremes.find(std::numeric_limits<int64_t>::max()), extremes.end());
+
+  // Unsigned keys with the highest bit set are greater than the others.
+  auto checkUnsigned = [](auto max) {
+    using Key = decltype(max);
+    std::vector<Key> keys{0, 1, max / 2 - 1, max / 2, max / 2 + 1, max / 2 + 2, max - 1, max};
+    BlockStatTree<Key> unsignedTree{};
+    for (auto it = keys.rbegin(); it != keys.rend(); ++it)
+      unsignedTree.insert(*it);
+
+    ASSERT_EQ(unsignedTree.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+      ASSERT_EQ(unsignedTree.rank(keys[i]), i);
+      ASSERT_EQ(*unsignedTree.select(i), keys[i]);
+      ASSERT_NE(unsignedTree.find(keys[i]), unsignedTree.end());
+    }
+    ASSERT_EQ(unsignedTree.countInRange(max / 2, max - 1), 4);
+    ASSERT_EQ(unsignedTree.erase(max / 2 + 1), 1);
+    ASSERT_EQ(unsignedTree.rank(max), keys.size() - 2);
+  };
+  checkUnsigned(std::numeric_limits<uint32_t>::max());
+  checkUnsigned(std::numeric_limits<uint64_t>::max());
+
+  BlockStatTree<double> doubles{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    doubles.insert(static_cast<double>(i) / 2);
+  doubles.insert(std::numeric_limits<double>::infinity());
+  ASSERT_EQ(doubles.rank(std::numeric_limits<double>::infinity()), TEST_INSERTS_NUM);
+  ASSERT_EQ(doubles.countInRange(1.0, 2.0), 3);
+}
+
+TEST(StatTreeTests, FrozenTreeTest)
+{
+  // Sizes around full Eytzinger levels.
+  for (size_t size : {size_t{0}, size_t{1}, size_t{2}, size_t{7}, size_t{8}, size_t{100}, TEST_INSERTS_NUM})
+  {
+    auto values = genRandom(size, TEST_INSERTS_NUM * 2);
+    StatTree<size_t> tree{};
+    for (auto value : values)
+      tree.insert(value);
+
+    auto frozen = tree.freeze();
+    ASSERT_EQ(frozen.size(), tree.size());
+    ASSERT_TRUE(std::equal(frozen.begin(), frozen.end(), tree.begin(), tree.end()));
+
+    for (size_t value = 0; value <= TEST_INSERTS_NUM * 2 + 1; ++value)
+    {
+      ASSERT_EQ(frozen.rank(value), tree.rank(value));
+      ASSERT_EQ(frozen.contains(value), tree.find(value) != tree.end());
+      if (frozen.contains(value))
+        ASSERT_EQ(*frozen.find(value), value);
+      else
+        ASSERT_EQ(frozen.find(value), frozen.end());
+      ASSERT_EQ(frozen.lower_bound(value) == frozen.end(), tree.lower_bound(value) == tree.end());
+      ASSERT_EQ(frozen.countInRange(value, value + 50), tree.countInRange(value, value + 50));
+    }
+    ASSERT_EQ(frozen.countInRange(10, 5), 0);
+
+    for (size_t k = 0; k < tree.size(); ++k)
+      ASSERT_EQ(*frozen.select(k), *tree.select(k));
+    ASSERT_EQ(frozen.select(tree.size()), frozen.end());
+  }
+
+  // Frozen tree keeps the order of the source.
+  StatTree<size_t, std::greater<size_t>> reversed{};
+  for (size_t i = 0; i < 10; ++i)
+    reversed.insert(i);
+  auto frozen = reversed.freeze();
+  ASSERT_EQ(*frozen.select(0), 9);
+  ASSERT_EQ(frozen.rank(3), 6);
+}
+
+TEST(StatTreeTests, TreeImageTest)
+{
+  std::string path = testing::TempDir() + "tree-image-test.bin";
+
+  for (size_t size : {size_t{0}, size_t{1}, size_t{100}, TEST_INSERTS_NUM})
+  {
+    StatTree<size_t> tree{};
+    for (auto value : genRandom(size, TEST_INSERTS_NUM * 2))
+      tree.insert(value);
+    tree.save(path);
+
+    auto mapped = FrozenStatTree<size_t, std::less<size_t>>::load(path);
+    ASSERT_TRUE(std::equal(mapped.begin(), mapped.end(), tree.begin(), tree.end()));
+    for (size_t value = 0; value <= TEST_INSERTS_NUM * 2; ++value)
+    {
+      ASSERT_EQ(mapped.rank(value), tree.rank(value));
+      ASSERT_EQ(mapped.contains(value), tree.find(value) != tree.end());
+    }
+
+    // Writable reload rebuilds aggregates as well.
+    auto loaded = TreeTester::SumTestTree::load(path);
+    ASSERT_TRUE(TreeTester::verify(loaded));
+    ASSERT_EQ(loaded.aggregate(), std::accumulate(tree.begin(), tree.end(), size_t{0}));
+    ASSERT_TRUE(std::equal(loaded.begin(), loaded.end(), tree.begin(), tree.end()));
+    loaded.insert(TEST_INSERTS_NUM * 3);
+    ASSERT_EQ(loaded.size(), tree.size() + 1);
+  }
+
+  // Image of other key type.
+  ASSERT_THROW((FrozenStatTree<int, std::less<int>>::load(path)), std::runtime_error);
+
+  // Damaged key.
+  {
+    std::fstream file{path, std::ios::in | std::ios::out | std::ios::binary};
+    file.seekp(100);
+    file.put('\x7F');
+  }
+  ASSERT_THROW(StatTree<size_t>::load(path), std::runtime_error);
+
+  // Truncated image.
+  std::filesystem::resize_file(path, 200);
+  ASSERT_THROW(StatTree<size_t>::load(path), std::runtime_error);
+
+  std::remove(path.c_str());
+  ASSERT_THROW(StatTree<size_t>::load(path), std::system_error);
+}
+
+TEST(StatTreeTests, DumpTest)
+{
+  StatTree<size_t> tree{};
+  for (auto value : genShuffled(TEST_INSERTS_NUM))
+    tree.insert(value);
+
+  auto countOf = [](const std::string &text, const std::string &pattern) {
+    size_t count = 0;
+    for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+      ++count;
+    return count;
+  };
+
+  // DOT: every node and nil has its own line, every edge as well.
+  std::ostringstream dot{};
+  tree.dump(dot);
+  ASSERT_TRUE(dot.str().starts_with("digraph DG {\n"));
+  ASSERT_EQ(countOf(dot.str(), "[label="), TEST_INSERTS_NUM);
+  ASSERT_EQ(countOf(dot.str(), " -> "), 2 * TEST_INSERTS_NUM);
+
+  // JSON with limits: written nodes plus cut sub trees cover the whole tree.
+  for (DumpOptions options : {DumpOptions{DumpFormat::JSON, 3}, DumpOptions{DumpFormat::JSON, SIZE_MAX, 100}})
+  {
+    std::ostringstream json{};
+    tree.dump(json, options);
+    size_t nodesNum = countOf(json.str(), "\"key\":");
+    if (options.maxDepth_ == 3)
+      ASSERT_EQ(nodesNum, 15);
+    else
+      ASSERT_EQ(nodesNum, 100);
+
+    size_t cutSize = 0;
+    for (size_t pos = json.str().find("\"cut\":"); pos != std::string::npos; pos = json.str().find("\"cut\":", pos + 1))
+      cutSize += std::stoul(json.str().substr(pos + 6));
+    ASSERT_EQ(nodesNum + cutSize, TEST_INSERTS_NUM);
+  }
+
+  // Binary: fixed size records in pre-order, the root first.
+  std::string path = testing::TempDir() + "tree-dump-test.bin";
+  tree.dump(path, DumpOptions{DumpFormat::BINARY});
+  std::ifstream in{path, std::ios::binary};
+  std::string binary{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+  constexpr size_t RECORD_SIZE = 2 * sizeof(uint64_t) + 1 + sizeof(size_t);
+  ASSERT_EQ(binary.size(), DUMP_MAGIC.size() + sizeof(uint32_t) + TEST_INSERTS_NUM * RECORD_SIZE);
+  ASSERT_TRUE(binary.starts_with(DUMP_MAGIC));
+  uint64_t rootParent = 0;
+  std::memcpy(&rootParent, binary.data() + DUMP_MAGIC.size() + sizeof(uint32_t), sizeof(rootParent));
+  ASSERT_EQ(rootParent, DUMP_NO_PARENT);
+  std::remove(path.c_str());
+
+  // Around key: the sub tree of the key node, the whole tree if levelsUp is large.
+  std::ostringstream around{};
+  tree.dumpAround(around, size_t{0}, 0, DumpOptions{DumpFormat::JSON});
+  ASSERT_NE(around.str().find("{\"id\":0,\"parent\":null,\"right\":false,\"key\":0,"), std::string::npos);
+  std::ostringstream aroundAll{};
+  tree.dumpAround(aroundAll, size_t{0}, SIZE_MAX, DumpOptions{DumpFormat::JSON});
+  ASSERT_EQ(countOf(aroundAll.str(), "\"key\":"), TEST_INSERTS_NUM);
+
+  // Not numeric keys are quoted and escaped.
+  StatTree<std::string> strings{};
+  strings.insert("a\"b");
+  std::ostringstream escaped{};
+  strings.dump(escaped, DumpOptions{DumpFormat::JSON});
+  ASSERT_NE(escaped.str().find("\"key\":\"a\\\"b\""), std::string::npos);
+  ASSERT_THROW(strings.dump(escaped, DumpOptions{DumpFormat::BINARY}), std::invalid_argument);
+}
+
+TEST(StatTreeTests, StatsTest)
+{
+  using CountedTree = StatTree<size_t, std::less<size_t>, std::allocator<size_t>, NoAggregate, CountingStats>;
+
+  CountedTree tree{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM; ++i)
+    tree.insert(i);
+  for (size_t i = 0; i < TEST_ERASES_NUM; ++i)
+    tree.erase(i * 3);
+
+  auto stats = tree.stats();
+  ASSERT_EQ(stats.size_, TEST_INSERTS_NUM - TEST_ERASES_NUM);
+  ASSERT_EQ(stats.nodesCreated_, TEST_INSERTS_NUM);
+  ASSERT_EQ(stats.nodesDestroyed_, TEST_ERASES_NUM);
+  ASSERT_GT(stats.comparisons_, 0);
+  ASSERT_GT(stats.height_, 0);
+  ASSERT_LE(stats.height_, 2 * std::bit_width(stats.size_ + 1));
+
+  // Sorted inserts go right all the time, so the tree is rebalanced by rotations.
+  ASSERT_GT(stats.fixups(FixupCase::INSERT_LINE), 0);
+  ASSERT_EQ(stats.insertFixupIterations_,
+            stats.fixups(FixupCase::INSERT_RECOLOR) + stats.fixups(FixupCase::INSERT_LINE));
+  ASSERT_EQ(stats.eraseFixupIterations_,
+            stats.fixups(FixupCase::ERASE_RECOLOR) + stats.fixups(FixupCase::ERASE_FAR_NEPHEW));
+  uint64_t rotations = 0;
+  for (auto fixupCase : {FixupCase::INSERT_TRIANGLE, FixupCase::INSERT_LINE, FixupCase::ERASE_RED_BROTHER,
+                         FixupCase::ERASE_NEAR_NEPHEW, FixupCase::ERASE_FAR_NEPHEW})
+    rotations += stats.fixups(fixupCase);
+  ASSERT_EQ(stats.rotations_, rotations);
+
+  // Every insert and erase makes one descent, so do queries.
+  ASSERT_EQ(stats.descents(), TEST_INSERTS_NUM + TEST_ERASES_NUM);
+  tree.rank(5);
+  tree.select(5);
+  ASSERT_EQ(tree.stats().descents(), TEST_INSERTS_NUM + TEST_ERASES_NUM + 2);
+
+  tree.resetStats();
+  ASSERT_EQ(tree.stats().comparisons_, 0);
+  ASSERT_TRUE(std::is_sorted(std::begin(tree), std::end(tree)));
+
+  // Large batches rebuild the tree, its new and released nodes are counted.
+  CountedTree batched{};
+  for (size_t i = 0; i < TEST_INSERTS_NUM / 10; ++i)
+    batched.insert(i);
+  std::vector<size_t> batch(TEST_INSERTS_NUM * 3 / 10);
+  std::iota(std::begin(batch), std::end(batch), TEST_INSERTS_NUM / 10);
+  ASSERT_EQ(batched.insertBatch(batch), batch.size());
+
+  auto batchStats = batched.stats();
+  ASSERT_EQ(batchStats.size_, TEST_INSERTS_NUM * 4 / 10);
+  ASSERT_EQ(batchStats.nodesCreated_, TEST_INSERTS_NUM / 10 + TEST_INSERTS_NUM * 4 / 10);
+  ASSERT_EQ(batchStats.nodesDestroyed_, TEST_INSERTS_NUM / 10);
+
+  ASSERT_EQ(batched.eraseBatch(batch), batch.size());
+  batchStats = batched.stats();
+  ASSERT_EQ(batchStats.nodesCreated_ - batchStats.nodesDestroyed_, batched.size());
+}
+
+TEST(StatTreeTests, TraversalTest)
+{
+  StatTree<size_t> tree{};
+  for (auto value : genRandom(TEST_INSERTS_NUM, TEST_INSERTS_NUM * 2))
+    tree.insert(value);
+
+  using Visited = std::vector<std::pair<size_t, size_t>>;
+  auto collect = [&tree]<TraversalOrder Order>() {
+    Visited visited{};
+    bool passed = tree.traverse<Order>([&visited](size_t value, size_t depth) { visited.emplace_back(value, depth); });
+    EXPECT_TRUE(passed);
+    return visited;
+  };
+
+  Visited pre = collect.operator()<TraversalOrder::PRE>();
+  Visited in = collect.operator()<TraversalOrder::IN>();
+  Visited post = collect.operator()<TraversalOrder::POST>();
+  Visited level = collect.operator()<TraversalOrder::LEVEL>();
+  for (const auto *visited : {&pre, &in, &post, &level})
+    ASSERT_EQ(visited->size(), tree.size());
+
+  // Every order sees the same depths, and in-order is sorted.
+  std::map<size_t, size_t> depths(std::begin(pre), std::end(pre));
+  for (const auto *visited : {&in, &post, &level})
+    ASSERT_EQ((std::map<size_t, size_t>(std::begin(*visited), std::end(*visited))), depths);
+  ASSERT_TRUE(std::equal(std::begin(in), std::end(in), std::begin(tree), std::end(tree),
+                         [](const auto &visited, size_t value) { return visited.first == value; }));
+
+  // Pre-order goes down one level at most, the root is the first there and the last in post-order.
+  ASSERT_EQ(pre.front().second, 0);
+  ASSERT_EQ(pre.front(), post.back());
+  for (size_t i = 1; i < pre.size(); ++i)
+    ASSERT_LE(pre[i].second, pre[i - 1].second + 1);
+  // Levels go by depth and from the left to the right.
+  for (size_t i = 1; i < level.size(); ++i)
+    ASSERT_TRUE(level[i - 1].second < level[i].second ||
+                (level[i - 1].second == level[i].second && level[i - 1].first < level[i].first));
+
+  // Pruning and stopping.
+  size_t visitedNum = 0;
+  auto topLevels = [&visitedNum](size_t, size_t depth) {
+    ++visitedNum;
+    return depth == 2 ? Visit::SKIP_CHILDREN : Visit::CONTINUE;
+  };
+  ASSERT_TRUE(tree.traverse<TraversalOrder::PRE>(topLevels));
+  ASSERT_EQ(visitedNum, 7);
+
+  visitedNum = 0;
+  auto firstTen = [&visitedNum](size_t, size_t) { return ++visitedNum == 10 ? Visit::STOP : Visit::CONTINUE; };
+  ASSERT_FALSE(tree.traverse<TraversalOrder::POST>(firstTen));
+  ASSERT_EQ(visitedNum, 10);
+
+  // Parallel aggregation and stop.
+  struct Summer
+  {
+    size_t sum_ = 0;
+    size_t count_ = 0;
+
+    void operator()(size_t value, size_t)
+    {
+      sum_ += value;
+      ++count_;
+    }
+  };
+  auto mergeSums = [](Summer &to, Summer &&from) {
+    to.sum_ += from.sum_;
+    to.count_ += from.count_;
+  };
+  for (size_t threadsNum : {1, 2, 4, 7})
+  {
+    Summer summer{};
+    ASSERT_TRUE(tree.traverseParallel(summer, mergeSums, threadsNum));
+    ASSERT_EQ(summer.count_, tree.size());
+    ASSERT_EQ(summer.sum_, std::accumulate(std::begin(tree), std::end(tree), size_t{0}));
+  }
+
+  auto stopAtMax = [max = *tree.rbegin()](size_t value, size_t) {
+    return value == max ? Visit::STOP : Visit::CONTINUE;
+  };
+  ASSERT_FALSE(tree.traverseParallel(stopAtMax, [](auto &, auto &&) {}, 4));
+}
+
+TEST(StatTreeTests, ParallelVerifyTest)
+{
+  TreeTester::TestTree tree{};
+  for (auto value : genShuffled(TreeTester::PARALLEL_VERIFY_SIZE * 2))
+    tree.insert(value);
+  for (size_t threadsNum : {1, 2, 3, 8})
+    ASSERT_TRUE(TreeTester::verify(tree, threadsNum));
+
+  // Every broken invariant is found both at the top and below the split depth.
+  auto expectBroken = [&tree](auto corrupt) {
+    corrupt();
+    EXPECT_FALSE(TreeTester::verify(tree, 1));
+    EXPECT_FALSE(TreeTester::verify(tree, 8));
+    corrupt();
+    EXPECT_TRUE(TreeTester::verify(tree, 8));
+  };
+  for (size_t k : {size_t{7}, tree.size() / 3, tree.size() - 2})
+  {
+    TreeTester::TestNode *node = TreeTester::nodeAt(tree, k);
+    TreeTester::TestNode *neighbour = TreeTester::nodeAt(tree, k - 1);
+    SCOPED_TRACE(k);
+
+    expectBroken([node, neighbour] { std::swap(node->data_, neighbour->data_); });
+    expectBroken([node] { node->leftSize_ ^= 1; });
+    expectBroken([node] {
+      using Color = decltype(node->color_);
+      node->color_ = node->color_ == Color{} ? Color{1} : Color{};
+    });
+    expectBroken([node, neighbour] { std::swap(node->parent_, neighbour->parent_); });
+  }
+}
+
+TEST(StatTreeTests, ConcurrentTreeTest)
+{
+  constexpr size_t READERS_NUM = 4;
+
+  ConcurrentStatTree<size_t> tree{};
+  // Even keys are always present, odd ones are inserted and erased by the writer.
+  for (auto value : genShuffled(TEST_INSERTS_NUM))
+    tree.insert(value * 2);
+
+  std::atomic<bool> done = false;
+  std::atomic<size_t> failsNum = 0;
+  auto reader = [&] {
+    for (size_t pass = 0; !done; ++pass)
+    {
+      size_t key = pass % TEST_INSERTS_NUM * 2;
+      size_t size = tree.size();
+      if (!tree.contains(key) || tree.rank(key) < pass % TEST_INSERTS_NUM || size < TEST_INSERTS_NUM)
+        ++failsNum;
+
+      auto selected = tree.select(size / 2);
+      size_t prev = 0;
+      size_t evensNum = 0;
+      bool isFirst = true;
+      tree.forEach([&](size_t value) {
+        failsNum += !isFirst && value <= prev;
+        evensNum += value % 2 == 0;
+        prev = value;
+        isFirst = false;
+      });
+      failsNum += !selected.has_value() || evensNum != TEST_INSERTS_NUM;
+    }
+  };
+
+  std::vector<std::thread> readers{};
+  for (size_t i = 0; i < READERS_NUM; ++i)
+    readers.emplace_back(reader);
+
+  auto odds = genShuffled(TEST_INSERTS_NUM);
+  for (size_t round = 0; round < 10; ++round)
+  {
+    for (auto value : odds)
+      ASSERT_TRUE(tree.insert(value * 2 + 1));
+    for (auto value : odds)
+      ASSERT_TRUE(tree.erase(value * 2 + 1));
+  }
+  done = true;
+
+  for (auto &thread : readers)
+    thread.join();
+
+  ASSERT_EQ(failsNum, 0);
+  ASSERT_EQ(tree.size(), TEST_INSERTS_NUM);
+  ASSERT_EQ(tree.countInRange(0, TEST_INSERTS_NUM), TEST_INSERTS_NUM / 2 + 1);
+  ASSERT_EQ(tree.select(TEST_INSERTS_NUM - 1), (TEST_INSERTS_NUM - 1) * 2);
+  ASSERT_FALSE(tree.select(TEST_INSERTS_NUM).has_value());
+
+  // Erased nodes are not reused while lock free readers may still hold them.
+  StatTree<size_t, std::less<size_t>, std::allocator<size_t>, NoAggregate, NoStats, PublishedLinks> published{};
+  const size_t *erased = &*published.insert(1).first;
+  ASSERT_EQ(published.erase(1), 1);
+  ASSERT_NE(&*published.insert(1).first, erased);
+}
+
+TEST(StatTreeTests, PersistentTreeTest)
+{
+  using TestTree = TreeTester::PersistentTestTree;
+
+  TestTree tree{};
+  std::vector<std::pair<TestTree::Snapshot, std::set<size_t>>> snapshots{};
+  std::set<size_t> expected{};
+
+  auto values = genRandom(TEST_INSERTS_NUM * 2, TEST_INSERTS_NUM);
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    // Inserts win, so the tree grows.
+    if (i % 3 == 2)
+      ASSERT_EQ(tree.erase(values[i]), expected.erase(values[i]));
+    else
+      ASSERT_EQ(tree.insert(values[i]), expected.insert(values[i]).second);
+
+    if (i % 100 == 0)
+      snapshots.emplace_back(tree.snapshot(), expected);
+  }
+  ASSERT_TRUE(TreeTester::verify(tree));
+
+  // Snapshots are not affected by later modifications and outlive the tree.
+  tree.clear();
+  for (auto &[snapshot, values] : snapshots)
+  {
+    ASSERT_EQ(snapshot.size(), values.size());
+    ASSERT_TRUE(std::equal(snapshot.begin(), snapshot.end(), std::begin(values), std::end(values)));
+
+    size_t k = 0;
+    for (auto value : values)
+    {
+      ASSERT_EQ(snapshot.rank(value), k);
+      ASSERT_EQ(*snapshot.select(k), value);
+      ASSERT_EQ(*snapshot.find(value), value);
+      ++k;
+    }
+    ASSERT_EQ(snapshot.select(k), snapshot.end());
+    ASSERT_EQ(snapshot.countInRange(0, TEST_INSERTS_NUM / 2),
+              std::distance(std::begin(values), values.upper_bound(TEST_INSERTS_NUM / 2)));
+
+    auto restored = snapshot.toTree();
+    for (auto value : values)
+      restored.erase(value);
+    ASSERT_TRUE(restored.empty());
+    ASSERT_TRUE(TreeTester::verify(restored));
+  }
 }
 
 } // namespace tree